@@ -19,10 +19,13 @@
 #include <vector>
 #include <limits>
 #include <Eigen/Dense>
+#include <bbn/point_blocks.h>
+#include <bbn/util.h>
 
 namespace bbn {
 
-	/* Provides nearest neighbor search in n-dimensions using exhaustive search and L2 metric. */
+	/* Provides nearest neighbor search in n-dimensions using exhaustive search and L2 metric. Points are additionally
+	   stored in structure-of-arrays blocks, so that distances are evaluated for a whole block at once. */
 	template<class VectorT>
 	class BruteforceLocator {
 	public:
@@ -33,18 +36,26 @@ namespace bbn {
 
 		/* Construct empty locator*/
 		inline BruteforceLocator()
+			:_head(detail::PointBlockPool<VectorT>::InvalidBlock)
 		{}
 
 		/* Construct empty locator*/
 		inline BruteforceLocator(const Params &p)
+			:_head(detail::PointBlockPool<VectorT>::InvalidBlock)
 		{}
 
 		/* Reset to empty state*/
 		void reset()
 		{
 			_points.clear();
+			_blocks.reset();
+			_head = detail::PointBlockPool<VectorT>::InvalidBlock;
 		}
 
+		/** Has no effect, exhaustive search keeps no per-radius state. */
+		void prepare(typename VectorT::Scalar)
+		{}
+
 		/** Number of dimensions. */
 		typename VectorT::Index dims() const
 		{
@@ -59,14 +70,35 @@ namespace bbn {
 		/** Add a new point. */
 		void add(const VectorT &point)
 		{
+			_head = _blocks.insert(_head, _points.size(), point);
 			_points.push_back(point);
 		}
 
+		/** Move the i-th stored point to a new position. */
+		void update(size_t index, const VectorT &point)
+		{
+			_points[index] = point;
+			_blocks.set(index, point);
+		}
+
 		/** Add a range of points. */
 		template<class VectorTIter>
 		void add(VectorTIter begin, VectorTIter end)
 		{
-			_points.insert(_points.end(), begin, end);
+			for (VectorTIter i = begin; i != end; ++i) {
+				add(*i);
+			}
+		}
+
+		/** Replace the current content by the columns of the given matrix. */
+		template<class Derived>
+		void build(const Eigen::MatrixBase<Derived> &points)
+		{
+			reset();
+			_points.reserve(static_cast<size_t>(points.cols()));
+			for (typename Derived::Index i = 0; i < points.cols(); ++i) {
+				add(points.col(i));
+			}
 		}
 
 		/** Get the i-th stored point. */
@@ -77,17 +109,16 @@ namespace bbn {
 
 		/* Find any neighbor within the specified radius.*/
 		inline bool findAnyWithinRadius(const VectorT &query, typename VectorT::Scalar radius, size_t *index = 0, typename VectorT::Scalar *dist2 = 0) const {			
-			typename VectorT::Scalar bestDist2 = radius * radius;
+			typedef typename VectorT::Scalar Scalar;
+
+			Scalar bestDist2 = radius * radius;
 			size_t bestIndex = std::numeric_limits<size_t>::max();
 			
-			for (size_t i = 0; i < _points.size(); ++i) {
-				const float d = (query - _points[i]).squaredNorm();
-				if (d <= bestDist2) {
-					bestDist2 = d;
-					bestIndex = i;
-					break;
-				}
-			}
+			_blocks.visit(_head, query, bestDist2, [&](size_t id, Scalar d, Scalar &) {
+				bestDist2 = d;
+				bestIndex = id;
+				return false;
+			});
 
 			if (dist2) *dist2 = bestDist2;
 			if (index) *index = bestIndex;
@@ -95,37 +126,45 @@ namespace bbn {
 			return bestIndex != std::numeric_limits<size_t>::max();
 		}
 
+		/* Invoke the visitor for each neighbor within the specified radius. The visitor receives the neighbor index and
+		   its squared distance and returns false to stop the search. Neighbors whose index is rejected by the filter
+		   are skipped, mostly before their distance is computed. Returns false if the search was stopped. */
+		template<class Visitor, class Filter = detail::AcceptAll>
+		inline bool forEachWithinRadius(const VectorT &query, typename VectorT::Scalar radius, Visitor &&visitor, Filter filter = Filter()) const {
+			typedef typename VectorT::Scalar Scalar;
+
+			Scalar r2 = radius * radius;
+			return _blocks.visit(_head, query, r2, [&](size_t id, Scalar d, Scalar &) {
+				return visitor(id, d);
+			}, filter);
+		}
+
 		/* Find all neighbors within the specified radius.*/
 		inline bool findAllWithinRadius(const VectorT &query, typename VectorT::Scalar radius, std::vector<size_t> &indices, std::vector<typename VectorT::Scalar> &dists2) const {
-
 			indices.clear();
 			dists2.clear();
 
-			const typename VectorT::Scalar r2 = radius * radius;
-			for (size_t i = 0; i < _points.size(); ++i) {
-				const float d = (query - _points[i]).squaredNorm();
-				if (d <= r2) {
-					indices.push_back(i);
-					dists2.push_back(d);
-				}
-			}
+			forEachWithinRadius(query, radius, [&](size_t id, typename VectorT::Scalar d) {
+				indices.push_back(id);
+				dists2.push_back(d);
+				return true;
+			});
 
 			return indices.size() > 0;
 		}
 
 		/* Find closest neighbor within the specified radius.*/
 		inline bool findClosestWithinRadius(const VectorT &query, typename VectorT::Scalar radius, size_t &index, typename VectorT::Scalar &dist2) const {
+			typedef typename VectorT::Scalar Scalar;
 
-			typename VectorT::Scalar bestDist2 = radius * radius + 0.01f;
+			Scalar bestDist2 = radius * radius + 0.01f;
 			size_t bestIndex = std::numeric_limits<size_t>::max();
 
-			for (size_t i = 0; i < _points.size(); ++i) {
-				const float d = (query - _points[i]).squaredNorm();
-				if (d < bestDist2) {
-					bestDist2 = d;
-					bestIndex = i;
-				}
-			}
+			_blocks.visit(_head, query, bestDist2, [&](size_t id, Scalar d, Scalar &r2) {
+				r2 = d;
+				bestIndex = id;
+				return true;
+			});
 
 			dist2 = bestDist2;
 			index = bestIndex;
@@ -136,6 +175,8 @@ namespace bbn {
 	private:
 		typedef std::vector<VectorT, Eigen::aligned_allocator<VectorT> > ArrayOfVectorT;
 		ArrayOfVectorT _points;
+		detail::PointBlockPool<VectorT> _blocks;
+		size_t _head;
 	};
 
 }
@@ -0,0 +1,639 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_BUCKETING_H
+#define BBN_BUCKETING_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+#include <bbn/scratch.h>
+
+namespace bbn {
+
+	/** Configuration parameters shared by the bucket based locators. */
+	struct BucketLocatorParams {
+		float bucketResolution;
+		/** Optional bucket sizes per dimension. Dimensions not covered use bucketResolution. */
+		std::vector<float> bucketResolutions;
+
+		/** Defaults */
+		BucketLocatorParams()
+			:bucketResolution(0.05f)
+		{}
+
+		/** Use separate bucket sizes for the position and feature block of stacked vectors. */
+		void setBlockResolutions(size_t positionDims, float positionResolution, size_t featureDims, float featureResolution)
+		{
+			bucketResolutions.assign(positionDims, positionResolution);
+			bucketResolutions.insert(bucketResolutions.end(), featureDims, featureResolution);
+		}
+	};
+
+	namespace detail {
+
+		/* Partitioning of n-dimensional space into regular buckets. Shared by all grid based locators. */
+		template<class VectorT>
+		struct Bucketing {
+
+			typedef typename VectorT::Scalar Scalar;
+
+			/* An bucket in n-dimensions. */
+			typedef typename Eigen::Matrix<int, VectorT::RowsAtCompileTime, 1> Bucket;
+
+			/* Bucket coordinates packed into a single integer. */
+			typedef std::uint64_t Code;
+
+			/* Number of dimensions up to which queries keep bucket coordinates on the stack. */
+			enum { InlineDims = (VectorT::RowsAtCompileTime != Eigen::Dynamic) ? int(VectorT::RowsAtCompileTime) : 32 };
+
+			/* Per-query bucket coordinates. */
+			typedef ScratchArray<int, InlineDims> BucketScratch;
+
+			/* Provides n-dimensional iteration over bucket indices. */
+			class RangeIterator {
+			public:
+				/* Construct iterator from range to iterate. Both corners are inclusive. */
+				RangeIterator(const Bucket &minCorner, const Bucket &maxCorner)
+					:_n(minCorner.rows()), _current(minCorner), _minCorner(minCorner), _maxCorner(maxCorner)
+				{
+					if (((_maxCorner - _minCorner).array() < 0).any()) {
+						_n = 0;
+					}
+				}
+
+				/* Construct invalid or end iterator. */
+				RangeIterator()
+					:_n(0)
+				{}
+
+				const Bucket &operator*() const
+				{
+					return _current;
+				}
+
+				/* Increment iterator to next position. */
+				RangeIterator &operator++()
+				{
+					// Pop elements that correspond to maximum corner.
+					while (_n > 0 && _current(_n - 1) >= _maxCorner(_n - 1)) {
+						--_n;
+					}
+
+					// Increment position and fill up remainder
+					if (_n > 0) {
+						_current(_n - 1) += 1;
+
+						if (_n < _minCorner.rows()) {
+							const typename Bucket::Index nRowsToFill = _current.rows() - _n;
+							_current.tail(nRowsToFill) = _minCorner.tail(nRowsToFill);
+							_n = _minCorner.rows();
+						}
+					}
+
+					return *this;
+				}
+
+				/* Test for equality. */
+				bool operator==(const RangeIterator &other) const
+				{
+					if (_n == 0 || other._n == 0) {
+						return _n == 0 && other._n == 0;
+					}
+					else {
+						return _current == other._current;
+					}
+				}
+
+				/* Test for inequality. */
+				bool operator!=(const RangeIterator &other) const
+				{
+					return !operator==(other);
+				}
+
+			private:
+				typename Bucket::Index _n;
+				Bucket _current, _minCorner, _maxCorner;
+			};
+
+			/* Bucket sizes per dimension. A single size applies to all dimensions, unless per-dimension sizes are
+			   given. Dimensions beyond the given sizes fall back to the single size. */
+			class Resolution {
+			public:
+				/* Construct isotropic resolution. */
+				explicit Resolution(Scalar size = Scalar(0.05))
+					:_size(size), _invSize(Scalar(1) / size)
+				{}
+
+				/* Construct resolution from per-dimension sizes. */
+				template<class T>
+				Resolution(Scalar size, const std::vector<T> &sizes)
+					:_size(size), _invSize(Scalar(1) / size)
+				{
+					for (size_t i = 0; i < sizes.size(); ++i) {
+						_sizes.push_back(Scalar(sizes[i]));
+						_invSizes.push_back(Scalar(1) / Scalar(sizes[i]));
+					}
+				}
+
+				/* Size of buckets in the given dimension. */
+				inline Scalar size(typename Bucket::Index i) const
+				{
+					return static_cast<size_t>(i) < _sizes.size() ? _sizes[i] : _size;
+				}
+
+				/* Inverse size of buckets in the given dimension. */
+				inline Scalar invSize(typename Bucket::Index i) const
+				{
+					return static_cast<size_t>(i) < _invSizes.size() ? _invSizes[i] : _invSize;
+				}
+
+			private:
+				Scalar _size, _invSize;
+				std::vector<Scalar> _sizes, _invSizes;
+			};
+
+			/* Converts a point to a bucket. */
+			template<class Derived>
+			static inline Bucket toBucket(const Eigen::MatrixBase<Derived> &point, const Resolution &res)
+			{
+				Bucket b(point.rows(), 1);
+				toBucket(point, res, b.data());
+				return b;
+			}
+
+			/* Converts a point to a bucket and writes its coordinates to the given memory. */
+			template<class Derived>
+			static inline void toBucket(const Eigen::MatrixBase<Derived> &point, const Resolution &res, int *b)
+			{
+				for (typename Derived::Index i = 0; i < point.rows(); ++i) {
+					b[i] = static_cast<int>(std::floor(point(i) * res.invSize(i)));
+				}
+			}
+
+			/* Order the columns of points along a Z-order curve through their buckets, considering the first dims
+			   coordinates only. Points close in space are thus mostly close in the order. Points of a bucket are kept
+			   in index order. */
+			template<class Derived>
+			static void zOrder(const Eigen::MatrixBase<Derived> &points, typename Bucket::Index dims, const Resolution &res, std::vector<size_t> &order)
+			{
+				const size_t n = static_cast<size_t>(points.cols());
+				order.resize(n);
+				if (n == 0 || dims <= 0)
+					return;
+
+				std::vector<int> keys(n * dims);
+				for (size_t i = 0; i < n; ++i) {
+					toBucket(points.col(static_cast<typename Derived::Index>(i)).head(dims), res, &keys[i * dims]);
+					order[i] = i;
+				}
+
+				// Offset coordinates to non-negative values.
+				std::vector<std::uint32_t> z(n * dims);
+				for (typename Bucket::Index k = 0; k < dims; ++k) {
+					int minKey = keys[k];
+					for (size_t i = 1; i < n; ++i) {
+						minKey = std::min(minKey, keys[i * dims + k]);
+					}
+					for (size_t i = 0; i < n; ++i) {
+						z[i * dims + k] = static_cast<std::uint32_t>(std::int64_t(keys[i * dims + k]) - minKey);
+					}
+				}
+
+				// Coordinates compare by the dimension of the most significant differing bit (Chan).
+				std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+					const std::uint32_t *za = &z[a * dims];
+					const std::uint32_t *zb = &z[b * dims];
+
+					typename Bucket::Index msd = 0;
+					std::uint32_t x = 0;
+					for (typename Bucket::Index k = 0; k < dims; ++k) {
+						const std::uint32_t y = za[k] ^ zb[k];
+						if (x < y && x < (x ^ y)) {
+							msd = k;
+							x = y;
+						}
+					}
+					return za[msd] < zb[msd];
+				});
+			}
+
+			/* Number of bits per dimension in bucket codes. */
+			static inline int codeBits(typename Bucket::Index dims)
+			{
+				return std::max<int>(64 / static_cast<int>(dims), 1);
+			}
+
+			/* Packs bucket coordinates into a 64-bit code. Each dimension receives 64 / n bits (at least one), coordinates
+			   are added in two's complement with wrap-around. The packing is linear, i.e code(a + b) == code(a) + code(b),
+			   and exact as long as coordinates fit into their bits, see fitsCode. Otherwise distinct buckets share a code,
+			   which does not affect the results of locators that test the distance of every candidate point, but lets
+			   them test far more candidates. Locators therefore switch to hashCode for buckets that do not fit. */
+			static inline Code toCode(const int *b, typename Bucket::Index dims)
+			{
+				const int bits = codeBits(dims);
+
+				Code c = 0;
+				for (typename Bucket::Index i = 0; i < dims; ++i) {
+					c += static_cast<Code>(static_cast<std::int64_t>(b[i])) << ((i * bits) % 64);
+				}
+				return c;
+			}
+
+			/* Test if bucket coordinates fit into the bits of their dimension, so that toCode is exact. */
+			static inline bool fitsCode(const int *b, typename Bucket::Index dims)
+			{
+				const int bits = codeBits(dims);
+				if (bits >= 32)
+					return true;
+
+				const std::int64_t limit = std::int64_t(1) << (bits - 1);
+				for (typename Bucket::Index i = 0; i < dims; ++i) {
+					if (b[i] < -limit || b[i] >= limit)
+						return false;
+				}
+				return true;
+			}
+
+			/* Hashes all bucket coordinates into a 64-bit code. In contrast to toCode, distinct buckets have distinct
+			   codes except for rare hash collisions, but codes are not linear in the coordinates. */
+			static inline Code hashCode(const int *b, typename Bucket::Index dims)
+			{
+				Code h = 0x9E3779B97F4A7C15ull;
+				for (typename Bucket::Index i = 0; i < dims; ++i) {
+					h = (h ^ static_cast<Code>(static_cast<std::uint32_t>(b[i]))) * 0xFF51AFD7ED558CCDull;
+					h ^= h >> 32;
+				}
+				return h;
+			}
+
+			/* Converts a point to a bucket code. */
+			template<class Derived>
+			static inline Code toCode(const Eigen::MatrixBase<Derived> &point, const Resolution &res)
+			{
+				Bucket b(point.rows(), 1);
+				toBucket(point, res, b.data());
+				return toCode(b.data(), b.rows());
+			}
+
+			/* Relative offsets of all buckets that may intersect a ball of the given radius whose center lies anywhere
+			   inside the home bucket. Since search radii are fixed for the duration of an algorithm, the stencil is
+			   computed once per radius and queries only add its offsets to their home bucket.
+
+			   Offsets are ordered nearest first by the minimum distance between their bucket and the home bucket, ties are
+			   broken by ring (L1 norm), so that the home bucket comes first. Searches with a shrinking radius can therefore
+			   stop as soon as the minimum distance of the next offset exceeds the current radius. For the same reason a
+			   stencil serves all radii up to its own at about the cost of a stencil computed for the smaller radius.
+
+			   The number of offsets grows exponentially with the number of dimensions. Stencils whose bounding box exceeds
+			   MaximumSize buckets are not computed and marked unbounded, queries then fall back to forEachBucketInRange. */
+			struct Stencil {
+				/* Maximum number of buckets in the bounding box of a stencil. */
+				enum { MaximumSize = 1 << 18 };
+
+				Stencil()
+					:radius(-1), dims(0), bounded(false)
+				{}
+
+				/* Compute stencil for the given radius. Buckets are pruned by their minimum distance to the home bucket. */
+				void compute(typename Bucket::Index nDims, Scalar r, const Resolution &res)
+				{
+					radius = r;
+					dims = nDims;
+
+					// Number of buckets to search in each direction and layout of per-dimension slab tables.
+					extents.resize(dims);
+					slabBase.resize(dims);
+					int nSlabs = 0;
+					double boxSize = 1;
+					for (typename Bucket::Index i = 0; i < dims; ++i) {
+						extents[i] = static_cast<int>(std::min<Scalar>(std::floor(r * res.invSize(i)), Scalar(MaximumSize))) + 1;
+						slabBase[i] = nSlabs + extents[i];
+						nSlabs += 2 * extents[i] + 1;
+						boxSize *= 2.0 * extents[i] + 1.0;
+					}
+
+					offsets.clear();
+					minDist2.clear();
+					codes.clear();
+					codeOffsets.clear();
+					codeMinDist2.clear();
+
+					bounded = boxSize <= double(MaximumSize);
+					if (!bounded)
+						return;
+
+					const Bucket minCorner = -Eigen::Map<const Bucket>(&extents[0], dims);
+					const Bucket maxCorner = Eigen::Map<const Bucket>(&extents[0], dims);
+
+					// Collect offsets keyed by minimum distance and ring.
+					std::vector<int> candidates;
+					std::vector<std::pair<std::pair<Scalar, int>, int> > order;
+
+					RangeIterator end;
+					for (RangeIterator biter(minCorner, maxCorner); biter != end; ++biter) {
+						const Bucket &o = *biter;
+
+						Scalar d2 = 0;
+						int ring = 0;
+						for (typename Bucket::Index i = 0; i < dims; ++i) {
+							const Scalar e = std::max<Scalar>(Scalar(std::abs(o(i)) - 1), 0) * res.size(i);
+							d2 += e * e;
+							ring += std::abs(o(i));
+						}
+
+						if (d2 <= r * r) {
+							order.push_back(std::make_pair(std::make_pair(d2, ring), static_cast<int>(order.size())));
+							candidates.insert(candidates.end(), o.data(), o.data() + dims);
+						}
+					}
+					std::sort(order.begin(), order.end());
+
+					const size_t n = order.size();
+					offsets.resize(n * dims);
+					minDist2.resize(n);
+					for (size_t s = 0; s < n; ++s) {
+						const int *o = &candidates[order[s].second * dims];
+						std::copy(o, o + dims, offsets.begin() + s * dims);
+						minDist2[s] = order[s].first.first;
+					}
+
+					// Codes of offsets, merging offsets that share a code. Merged offsets cannot be pruned individually
+					// and inherit the smallest minimum distance of their members.
+					std::vector<std::pair<Code, int> > sorted(n);
+					for (size_t s = 0; s < n; ++s) {
+						sorted[s] = std::make_pair(toCode(&offsets[s * dims], dims), static_cast<int>(s));
+					}
+					std::sort(sorted.begin(), sorted.end());
+
+					std::vector<std::pair<int, std::pair<Code, int> > > unique;
+					for (size_t s = 0; s < n; ++s) {
+						if (!unique.empty() && unique.back().second.first == sorted[s].first) {
+							unique.back().second.second = -1;
+						} else {
+							unique.push_back(std::make_pair(sorted[s].second, std::make_pair(sorted[s].first, sorted[s].second)));
+						}
+					}
+					std::sort(unique.begin(), unique.end());
+
+					codes.resize(unique.size());
+					codeOffsets.resize(unique.size());
+					codeMinDist2.resize(unique.size());
+					for (size_t s = 0; s < unique.size(); ++s) {
+						codes[s] = unique[s].second.first;
+						codeOffsets[s] = unique[s].second.second;
+						codeMinDist2[s] = minDist2[unique[s].first];
+					}
+				}
+
+				/* Number of offsets. */
+				size_t size() const
+				{
+					return dims == 0 ? 0 : offsets.size() / static_cast<size_t>(dims);
+				}
+
+				/* Total number of slabs over all dimensions. */
+				int slabCount() const
+				{
+					return dims == 0 ? 0 : slabBase[dims - 1] + extents[dims - 1] + 1;
+				}
+
+				Scalar radius;
+				typename Bucket::Index dims;
+				/* False if the stencil exceeds MaximumSize and holds no offsets. */
+				bool bounded;
+				std::vector<int> offsets;
+				/* Minimum squared distance between the bucket of each offset and the home bucket. */
+				std::vector<Scalar> minDist2;
+				/* Extent of the stencil per dimension and position of the zero offset in per-dimension slab tables. */
+				std::vector<int> extents, slabBase;
+				/* Distinct offset codes and the index of their offset, or -1 when several offsets share the code. */
+				std::vector<Code> codes;
+				std::vector<int> codeOffsets;
+				std::vector<Scalar> codeMinDist2;
+			};
+
+			/* Stencils for the search radii announced through prepare. Stencils are only computed by the non-const members,
+			   queries look them up read-only and may therefore run concurrently. */
+			class StencilCache {
+			public:
+				StencilCache()
+					:_dims(0)
+				{}
+
+				/* Announce queries up to the given radius. The stencil is computed as soon as the number of dimensions is
+				   known, i.e immediately for fixed size vectors. */
+				void prepare(Scalar radius, typename Bucket::Index dims, const Resolution &res)
+				{
+					if (std::find(_radii.begin(), _radii.end(), radius) == _radii.end()) {
+						_radii.push_back(radius);
+					}
+					update(dims, res);
+				}
+
+				/* Compute missing stencils for the given number of dimensions. Unknown (negative) dimensions are ignored. */
+				inline void update(typename Bucket::Index dims, const Resolution &res)
+				{
+					if (dims <= 0 || (dims == _dims && _stencils.size() == _radii.size()))
+						return;
+
+					if (dims != _dims) {
+						_stencils.clear();
+						_dims = dims;
+					}
+
+					while (_stencils.size() < _radii.size()) {
+						_stencils.push_back(Stencil());
+						_stencils.back().compute(dims, _radii[_stencils.size() - 1], res);
+					}
+				}
+
+				/* Find the smallest bounded stencil that serves the given radius. Returns null if there is none. */
+				inline const Stencil *find(Scalar radius, typename Bucket::Index dims) const
+				{
+					const Stencil *best = 0;
+					for (size_t i = 0; i < _stencils.size(); ++i) {
+						const Stencil &s = _stencils[i];
+						if (s.bounded && s.dims == dims && s.radius >= radius && (best == 0 || s.radius < best->radius)) {
+							best = &s;
+						}
+					}
+					return best;
+				}
+
+			private:
+				std::vector<Scalar> _radii;
+				std::vector<Stencil> _stencils;
+				typename Bucket::Index _dims;
+			};
+
+			/* Number of buckets in the range covering the ball of radius r around query. Ranges too wide for the codes of
+			   their buckets to be distinct are reported as infinitely large. */
+			static inline double rangeSize(const VectorT &query, const Resolution &res, Scalar r)
+			{
+				const int bits = codeBits(query.rows());
+
+				double n = 1;
+				for (typename VectorT::Index i = 0; i < query.rows(); ++i) {
+					const double lo = std::floor((query(i) - r) * res.invSize(i));
+					const double hi = std::floor((query(i) + r) * res.invSize(i));
+					if (bits < 64 && hi - lo >= std::ldexp(1.0, bits))
+						return std::numeric_limits<double>::infinity();
+					n *= hi - lo + 1;
+				}
+				return n;
+			}
+
+			/* Invoke the given function for all buckets of the range covering the ball of radius r around query that
+			   overlap the ball of squared radius r2. Used when no stencil is available, e.g for large radii in high
+			   dimensions. Buckets are visited in no particular order and passed as pointer to their coordinates. The
+			   radius may shrink in between calls. The function returns false to stop the iteration. Returns false if
+			   the iteration was stopped. Unlike the stencil based iteration, this allocates for dynamically sized
+			   vectors. */
+			template<class Fnc>
+			static inline bool forEachBucketInRange(const VectorT &query, const Resolution &res, Scalar r, const Scalar &r2, Fnc &&fnc)
+			{
+				const typename VectorT::Index dims = query.rows();
+
+				Bucket minCorner(dims), maxCorner(dims);
+				for (typename VectorT::Index i = 0; i < dims; ++i) {
+					minCorner(i) = static_cast<int>(std::floor((query(i) - r) * res.invSize(i)));
+					maxCorner(i) = static_cast<int>(std::floor((query(i) + r) * res.invSize(i)));
+				}
+
+				RangeIterator end;
+				for (RangeIterator biter(minCorner, maxCorner); biter != end; ++biter) {
+					const Bucket &b = *biter;
+
+					Scalar d2 = 0;
+					for (typename VectorT::Index i = 0; i < dims && d2 <= r2; ++i) {
+						const Scalar lower = Scalar(b(i)) * res.size(i);
+						const Scalar e = std::max<Scalar>(lower - query(i), 0) + std::max<Scalar>(query(i) - (lower + res.size(i)), 0);
+						d2 += e * e;
+					}
+
+					if (d2 <= r2 && !fnc(b.data()))
+						return false;
+				}
+
+				return true;
+			}
+
+			/* Invoke the given function for all buckets of the stencil that overlap the ball of squared radius r2 around
+			   query, nearest buckets first. Buckets are passed as pointer to their coordinates. The radius may shrink in
+			   between calls, further buckets are then tested against the new radius and the iteration ends once no
+			   remaining bucket can be within the radius. The function returns false to stop the iteration. Returns
+			   false if the iteration was stopped. */
+			template<class Fnc>
+			static inline bool forEachBucket(const Stencil &stencil, const VectorT &query, const Resolution &res, const Scalar &r2, Fnc &&fnc)
+			{
+				const typename Bucket::Index dims = query.rows();
+
+				BucketScratch home(dims), b(dims);
+				toBucket(query, res, home.data());
+				SlabDistances slabs(stencil, query, home.data(), res);
+
+				const size_t n = stencil.size();
+				for (size_t s = 0; s < n && stencil.minDist2[s] <= r2; ++s) {
+					const int *o = &stencil.offsets[s * dims];
+					if (!slabs.overlaps(o, r2))
+						continue;
+
+					for (typename Bucket::Index i = 0; i < dims; ++i) {
+						b[i] = home[i] + o[i];
+					}
+					if (!fnc(static_cast<const int *>(b.data())))
+						return false;
+				}
+
+				return true;
+			}
+
+			/* Same as forEachBucket but passes bucket codes to the function. Every code is visited at most once. */
+			template<class Fnc>
+			static inline bool forEachCode(const Stencil &stencil, const VectorT &query, const Resolution &res, const Scalar &r2, Fnc &&fnc)
+			{
+				const typename Bucket::Index dims = query.rows();
+
+				BucketScratch home(dims);
+				toBucket(query, res, home.data());
+				const Code homeCode = toCode(home.data(), dims);
+				SlabDistances slabs(stencil, query, home.data(), res);
+
+				const size_t n = stencil.codes.size();
+				for (size_t s = 0; s < n && stencil.codeMinDist2[s] <= r2; ++s) {
+					const int o = stencil.codeOffsets[s];
+					if (o >= 0 && !slabs.overlaps(&stencil.offsets[o * dims], r2))
+						continue;
+
+					if (!fnc(homeCode + stencil.codes[s]))
+						return false;
+				}
+
+				return true;
+			}
+
+		private:
+
+			/* Squared distances from a query to the slabs of neighboring buckets in each dimension. Summing the slab
+			   distances of an offset yields the squared distance from the query to the bucket. Tables of up to 128 slabs
+			   are kept on the stack, e.g stencils extending up to nine buckets in each of six dimensions. */
+			class SlabDistances {
+			public:
+				SlabDistances(const Stencil &stencil, const VectorT &query, const int *home, const Resolution &res)
+					:_base(&stencil.slabBase[0]),
+					// Use the compile-time dimension if available, so that the loops below can be unrolled.
+					_dims((VectorT::RowsAtCompileTime != Eigen::Dynamic) ? typename Bucket::Index(VectorT::RowsAtCompileTime) : query.rows()),
+					_slabs(static_cast<size_t>(stencil.slabCount()))
+				{
+					for (typename Bucket::Index i = 0; i < _dims; ++i) {
+						const Scalar cellSize = res.size(i);
+						const int extent = stencil.extents[i];
+						for (int o = -extent; o <= extent; ++o) {
+							const Scalar lower = Scalar(home[i] + o) * cellSize;
+							const Scalar e = std::max<Scalar>(lower - query(i), 0) + std::max<Scalar>(query(i) - (lower + cellSize), 0);
+							_slabs[_base[i] + o] = e * e;
+						}
+					}
+				}
+
+				/* Test if the bucket at the given offset is within squared distance r2. */
+				inline bool overlaps(const int *o, Scalar r2) const
+				{
+					Scalar d2 = 0;
+					for (typename Bucket::Index i = 0; i < _dims && d2 <= r2; ++i) {
+						d2 += _slabs[_base[i] + o[i]];
+					}
+					return d2 <= r2;
+				}
+
+			private:
+				SlabDistances(const SlabDistances &);
+				SlabDistances &operator=(const SlabDistances &);
+
+				const int *_base;
+				typename Bucket::Index _dims;
+				ScratchArray<Scalar, 128> _slabs;
+			};
+		};
+
+	}
+}
+
+#endif
@@ -0,0 +1,139 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_CELL_TABLE_H
+#define BBN_CELL_TABLE_H
+
+#include <vector>
+#include <cstdint>
+
+namespace bbn {
+	namespace detail {
+
+		/* Open-addressing hash table mapping 64-bit cell codes to values of type size_t. Slots store code and value
+		   side by side in a single power of two sized array and collisions are resolved by linear probing, so that a
+		   lookup usually touches a single cache line. The table is kept at most half full. Entries cannot be removed. */
+		class CellTable {
+		public:
+			typedef std::uint64_t Code;
+
+			/** Construct empty table. */
+			CellTable()
+				:_size(0), _shift(64)
+			{}
+
+			/** Remove all entries. */
+			void clear()
+			{
+				_slots.clear();
+				_size = 0;
+				_shift = 64;
+			}
+
+			/** Number of entries. */
+			size_t size() const
+			{
+				return _size;
+			}
+
+			/** Find the value of the given code. Returns null if the code is not present. */
+			inline const size_t *find(Code code) const
+			{
+				if (_size == 0)
+					return 0;
+
+				const size_t mask = _slots.size() - 1;
+				for (size_t i = slotOf(code); _slots[i].used; i = (i + 1) & mask) {
+					if (_slots[i].code == code)
+						return &_slots[i].value;
+				}
+				return 0;
+			}
+
+			/** Find the value of the given code, inserting the code with the given value if not present. */
+			size_t &findOrInsert(Code code, size_t value)
+			{
+				if ((_size + 1) * 2 > _slots.size()) {
+					grow();
+				}
+
+				const size_t mask = _slots.size() - 1;
+				size_t i = slotOf(code);
+				for (; _slots[i].used; i = (i + 1) & mask) {
+					if (_slots[i].code == code)
+						return _slots[i].value;
+				}
+
+				_slots[i].code = code;
+				_slots[i].value = value;
+				_slots[i].used = true;
+				++_size;
+				return _slots[i].value;
+			}
+
+		private:
+
+			struct Slot {
+				Slot()
+					:code(0), value(0), used(false)
+				{}
+
+				Code code;
+				size_t value;
+				bool used;
+			};
+
+			/* Home slot of code using Fibonacci hashing, which spreads the linearly packed codes of neighboring cells. */
+			inline size_t slotOf(Code code) const
+			{
+				return static_cast<size_t>((code * 0x9E3779B97F4A7C15ull) >> _shift);
+			}
+
+			/* Double the number of slots and reinsert all entries. */
+			void grow()
+			{
+				std::vector<Slot> prev;
+				prev.swap(_slots);
+
+				const size_t capacity = prev.empty() ? 16 : prev.size() * 2;
+				_slots.resize(capacity);
+
+				_shift = 64;
+				for (size_t c = capacity; c > 1; c >>= 1) {
+					--_shift;
+				}
+
+				const size_t mask = capacity - 1;
+				for (size_t p = 0; p < prev.size(); ++p) {
+					if (!prev[p].used)
+						continue;
+
+					size_t i = slotOf(prev[p].code);
+					while (_slots[i].used) {
+						i = (i + 1) & mask;
+					}
+					_slots[i] = prev[p];
+				}
+			}
+
+			std::vector<Slot> _slots;
+			size_t _size;
+			int _shift;
+		};
+
+	}
+}
+
+#endif
@@ -18,7 +18,13 @@
 
 #include <Eigen/Dense>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
 #include <bbn/task_traits.h>
+#include <bbn/kdtree_locator.h>
+#include <bbn/parallel.h>
 #include <bbn/util.h>
 
 namespace bbn {
@@ -30,10 +36,24 @@ namespace bbn {
 		
 		typedef typename Traits::Scalar Scalar;
 		typedef typename Traits::Vector Vector;
+		typedef typename Eigen::Matrix<Scalar, Traits::PositionDimsAtCompileTime, 1> PositionVector;		/** Vector type of the positional block */
+		typedef typename Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> RadiusMatrix;				/** Conflict radii between pairs of classes */
+
+		/** Reasons for resampling to stop. */
+		enum StopReason {
+			StopNotRun,					/** Resampling has not been run yet. */
+			StopMaximumAttempts,		/** The maximum number of attempts was reached. */
+			StopConsecutiveFailures,	/** The maximum number of consecutive failed attempts was reached. */
+			StopAcceptanceRate,			/** The acceptance rate dropped below the minimum acceptance rate. */
+			StopCoverageComplete,		/** Maximal sampling covered the entire domain. */
+			StopMaximumSubdivisions		/** Maximal sampling reached the maximum number of cell subdivisions. */
+		};
 
         /** Default constructor. */
 		DartThrowing()
-        : _conflictRadius(Scalar(0.01)), _n(100000)
+        : _conflictRadius(Scalar(0.01)), _n(100000), _nThreads(1),
+		  _maxFailures(0), _minAcceptanceRate(0), _acceptanceWindow(1000), _stopReason(StopNotRun),
+		  _maxSubdivisions(20), _seed(std::mt19937::default_seed), _maxProbes(16), _blockSize(4096)
         {}        
         
         /** Set the conflict radius that determines the resampling resolution. */
@@ -41,27 +61,84 @@ namespace bbn {
             _conflictRadius = r;
         }
         
-        /** Resampling stops after n consecutive samples failed to contribute. */
+        /** Resampling stops after n samples were drawn in total. */
         void setMaximumAttempts(size_t n) {
             _n = n;
         }
 
+		/** Resampling stops after n consecutive samples failed to contribute. Zero disables this criterion, which is the default. */
+		void setMaximumConsecutiveFailures(size_t n) {
+			_maxFailures = n;
+		}
+
+		/** Resampling stops once the fraction of accepted samples among the last window samples drops below rate.
+			A rate of zero disables this criterion, which is the default. */
+		void setMinimumAcceptanceRate(float rate, size_t window = 1000) {
+			_minAcceptanceRate = rate;
+			_acceptanceWindow = std::max<size_t>(window, 1);
+		}
+
+		/** Set the number of times active cells are subdivided by maximal sampling before it gives up. Defaults to 20. */
+		void setMaximumSubdivisions(int n) {
+			_maxSubdivisions = n;
+		}
+
+		/** Set the maximum number of conflict radii tried by resampleToCount. Defaults to 16. */
+		void setMaximumProbes(int n) {
+			_maxProbes = n;
+		}
+
+		/** Get the conflict radius. Updated by resampleToCount. */
+		Scalar getConflictRadius() const {
+			return _conflictRadius;
+		}
+
+		/** Set the number of darts requested per call from block samplers. Defaults to 4096. */
+		void setBlockSize(size_t n) {
+			_blockSize = std::max<size_t>(n, 1);
+		}
+
+		/** Set the seed of the random number generator used by maximal sampling. */
+		void setSeed(unsigned seed) {
+			_seed = seed;
+		}
+
+		/** Reason the last call to resample stopped. */
+		StopReason getStopReason() const {
+			return _stopReason;
+		}
+
 		/* Set parameters specific to traits. */
 		void setTaskTraits(const Traits &t) {
 			_traits = t;
 		}
+
+		/** Set the number of threads used for resampling. Values other than one enable parallel dart throwing,
+			non-positive values use all hardware threads. Defaults to one. */
+		void setNumberOfThreads(int n) {
+			_nThreads = n;
+		}
         
         /** Resample input point cloud. */
 		template<typename SamplerFnc, typename VectorOutputIterator>
 		bool resample(SamplerFnc &sampler, VectorOutputIterator outputIter)
         {
+			if (_nThreads != 1 && _traits.getPositionDims() > 0) {
+				return resampleParallel(sampler, outputIter);
+			}
+
 			typename Traits::Locator loc(_traits.getLocatorParams());
+			loc.prepare(_conflictRadius);
+			SaturationMonitor monitor(*this);
 
 			int valids = 0;
-			for (size_t n = 0; n < _n; ++n) {
+			size_t n = 0;
+			while (n < _n) {
 				Vector v = sampler(); // Ask for a new sample.
+				++n;
 
-				if (!loc.findAnyWithinRadius(v, _conflictRadius)) {
+				const bool accepted = !loc.findAnyWithinRadius(v, _conflictRadius);
+				if (accepted) {
 					loc.add(v);
 					*outputIter++ = v;
 					++valids;
@@ -69,20 +146,773 @@ namespace bbn {
 
 				if (n % 5000 == 0) {
 					BBN_LOG("Dart throwing %.2f%% - Found %d in %d attempts\r",
-						(float)n / _n * 100, valids, n);
+						(float)n / _n * 100, valids, (int)n);
 				}
+
+				if (monitor.saturated(accepted))
+					break;
 			}
 
 			BBN_LOG("Dart throwing 100.00%% - Found %d in %d attempts\n",
-				valids, _n);
+				valids, (int)n);
 
+			_stopReason = monitor.reason;
 			return valids > 0;
         }
         
+		/** Progressive resampling of the input point cloud over a decreasing schedule of conflict radii.
+
+			Each level throws darts with its radius against all samples accepted so far, applying the stopping
+			criteria per level. The maximum number of attempts bounds the darts drawn over all levels. Each level may
+			use an equal share of the attempts left, attempts not used by a saturated level pass on to the following
+			levels. Samplers backed by a finite set of darts thus need to provide no more darts than for a single
+			pass. Samples are output in order of acceptance, so that the samples of the first k levels form a blue
+			noise set with the radius of level k and any prefix of the output is well spaced. The level at which each
+			sample was accepted is written to levelIter. Radii need to be in decreasing order. */
+		template<typename SamplerFnc, typename VectorOutputIterator, typename LevelOutputIterator>
+		bool resampleProgressive(SamplerFnc &sampler, const std::vector<float> &radii, VectorOutputIterator outputIter, LevelOutputIterator levelIter)
+		{
+			typename Traits::Locator loc(_traits.getLocatorParams());
+
+			int valids = 0;
+			size_t attempts = 0;
+			for (size_t level = 0; level < radii.size(); ++level) {
+				const Scalar r = static_cast<Scalar>(radii[level]);
+				SaturationMonitor monitor(*this);
+				loc.prepare(r);
+
+				const size_t levelAttempts = (_n - attempts) / (radii.size() - level);
+				size_t n = 0;
+				while (n < levelAttempts) {
+					Vector v = sampler();
+					++n;
+
+					const bool accepted = !loc.findAnyWithinRadius(v, r);
+					if (accepted) {
+						loc.add(v);
+						*outputIter++ = v;
+						*levelIter++ = static_cast<int>(level);
+						++valids;
+					}
+
+					if (monitor.saturated(accepted))
+						break;
+				}
+
+				attempts += n;
+				BBN_LOG("Dart throwing level %d - Radius %.5f - Found %d in total\n", (int)level, (float)r, valids);
+
+				_stopReason = monitor.reason;
+			}
+
+			return valids > 0;
+		}
+
+		/** Multi-class resampling in a single pass (Wei 2010).
+
+			The class function returns the class id of a dart in the range [0, radii.rows()). Two darts of classes
+			i and j conflict when their distance is within radii(i, j), the larger of radii(i, j) and radii(j, i) is
+			used for matrices that are not symmetric. Queries use the largest radius of the matrix and are filtered by
+			the classes of the neighbors found. Class ids of accepted darts are stored alongside the locator and
+			written to classIter. Use buildMultiClassRadii to derive a radius matrix for which each class and the
+			union of all classes are blue noise. */
+		template<typename SamplerFnc, typename ClassFnc, typename VectorOutputIterator, typename ClassOutputIterator>
+		bool resampleMultiClass(SamplerFnc &sampler, ClassFnc &classOf, const RadiusMatrix &radii, VectorOutputIterator outputIter, ClassOutputIterator classIter)
+		{
+			const RadiusMatrix symmetric = radii.cwiseMax(radii.transpose());
+			const RadiusMatrix radii2 = symmetric.cwiseProduct(symmetric);
+			const Scalar maxRadius = symmetric.maxCoeff();
+			std::vector<int> classes;
+
+			typename Traits::Locator loc(_traits.getLocatorParams());
+			loc.prepare(maxRadius);
+			SaturationMonitor monitor(*this);
+
+			int valids = 0;
+			size_t n = 0;
+			while (n < _n) {
+				Vector v = sampler();
+				const int c = static_cast<int>(classOf(v));
+				++n;
+
+				const bool accepted = loc.forEachWithinRadius(v, maxRadius, [&](size_t id, Scalar d2) {
+					return d2 > radii2(c, classes[id]);
+				});
+
+				if (accepted) {
+					loc.add(v);
+					classes.push_back(c);
+					*outputIter++ = v;
+					*classIter++ = c;
+					++valids;
+				}
+
+				if (n % 5000 == 0) {
+					BBN_LOG("Dart throwing %.2f%% - Found %d in %d attempts\r",
+						(float)n / _n * 100, valids, (int)n);
+				}
+
+				if (monitor.saturated(accepted))
+					break;
+			}
+
+			BBN_LOG("Dart throwing 100.00%% - Found %d in %d attempts\n",
+				valids, (int)n);
+
+			_stopReason = monitor.reason;
+			return valids > 0;
+		}
+
+		/** Build the conflict radius matrix of multiple classes from their individual radii (Wei 2010).
+
+			Classes are processed in order of decreasing radius. The diagonal holds the radius of each class. The
+			radius between a class and any class of equal or larger radius is derived from the combined density of
+			these classes, assuming the density of a class to be proportional to r^-dims over the positional
+			dimensions. */
+		RadiusMatrix buildMultiClassRadii(const std::vector<float> &classRadii) const
+		{
+			const size_t nClasses = classRadii.size();
+			const Scalar dims = Scalar(std::max<typename Vector::Index>(_traits.getPositionDims(), 1));
+
+			std::vector<size_t> order(nClasses);
+			for (size_t i = 0; i < nClasses; ++i) {
+				order[i] = i;
+			}
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+				return classRadii[a] > classRadii[b];
+			});
+
+			RadiusMatrix radii(nClasses, nClasses);
+			Scalar density = 0;
+			for (size_t begin = 0; begin < nClasses;) {
+				// Group classes of equal radius.
+				size_t end = begin;
+				while (end < nClasses && classRadii[order[end]] == classRadii[order[begin]]) {
+					density += std::pow(Scalar(classRadii[order[end]]), -dims);
+					++end;
+				}
+
+				const Scalar r = std::pow(density, Scalar(-1) / dims);
+				for (size_t k = begin; k < end; ++k) {
+					const size_t i = order[k];
+					for (size_t l = 0; l < end; ++l) {
+						radii(i, order[l]) = radii(order[l], i) = r;
+					}
+					radii(i, i) = Scalar(classRadii[i]);
+				}
+
+				begin = end;
+			}
+
+			return radii;
+		}
+
+		/** Resample input point cloud from a block sampler.
+
+			Instead of returning a single dart per call, the block sampler fills the columns of a Traits::Matrix
+			and returns the number of columns filled as size_t. Returning zero ends resampling. The matrix provides
+			stacked dimensions rows and block size columns and is reused for all calls, so that samplers can generate
+			and stack darts in a vectorized manner without allocations per dart. The last block is shrunk to the
+			remaining number of attempts, so that no darts are drawn beyond the maximum number of attempts. Darts of
+			a block that remain once a stopping criterion is met are discarded. Runs sequentially. */
+		template<typename BlockSamplerFnc, typename VectorOutputIterator>
+		bool resampleBlocks(BlockSamplerFnc &sampler, VectorOutputIterator outputIter)
+		{
+			typename Traits::Locator loc(_traits.getLocatorParams());
+			loc.prepare(_conflictRadius);
+			SaturationMonitor monitor(*this);
+
+			typename Traits::Matrix block(_traits.getStackedDims(), _blockSize);
+			Vector v(_traits.getStackedDims());
+
+			int valids = 0;
+			size_t n = 0;
+			bool saturated = false;
+			while (n < _n && !saturated) {
+				if (_n - n < static_cast<size_t>(block.cols())) {
+					block.resize(Eigen::NoChange, _n - n);
+				}
+
+				const size_t nDarts = std::min<size_t>(sampler(block), block.cols());
+				if (nDarts == 0)
+					break;
+
+				for (size_t i = 0; i < nDarts && !saturated; ++i) {
+					v = block.col(i);
+					++n;
+
+					const bool accepted = !loc.findAnyWithinRadius(v, _conflictRadius);
+					if (accepted) {
+						loc.add(v);
+						*outputIter++ = v;
+						++valids;
+					}
+
+					saturated = monitor.saturated(accepted);
+				}
+
+				BBN_LOG("Dart throwing %.2f%% - Found %d in %d attempts\r",
+					(float)n / _n * 100, valids, (int)n);
+			}
+
+			BBN_LOG("Dart throwing 100.00%% - Found %d in %d attempts\n",
+				valids, (int)n);
+
+			_stopReason = monitor.reason;
+			return valids > 0;
+		}
+
+		/** Resample input point cloud using a spatially varying conflict radius.
+
+			The radius function is evaluated once per dart and returns its conflict radius. Two darts conflict when
+			their distance is within the larger of their radii, so that dense regions can be sampled at a finer
+			resolution than flat ones. Radii of accepted darts are stored alongside the locator and queries use
+			the largest radius seen so far, keeping the search resolution of the locator stable. Runs sequentially. */
+		template<typename SamplerFnc, typename RadiusFnc, typename VectorOutputIterator>
+		bool resample(SamplerFnc &sampler, RadiusFnc &radius, VectorOutputIterator outputIter)
+		{
+			typename Traits::Locator loc(_traits.getLocatorParams());
+			SaturationMonitor monitor(*this);
+
+			std::vector<Scalar> radii;
+			Scalar maxRadius = 0, preparedRadius = 0;
+
+			int valids = 0;
+			size_t n = 0;
+			while (n < _n) {
+				Vector v = sampler();
+				const Scalar r = static_cast<Scalar>(radius(v));
+				++n;
+
+				// Prepare the locator ahead of the largest radius, so that growing radii only add few stencils.
+				maxRadius = std::max(maxRadius, r);
+				if (maxRadius > preparedRadius) {
+					preparedRadius = Scalar(1.5) * maxRadius;
+					loc.prepare(preparedRadius);
+				}
+
+				const bool accepted = loc.forEachWithinRadius(v, maxRadius, [&](size_t id, Scalar d2) {
+					const Scalar rc = std::max(r, radii[id]);
+					return d2 > rc * rc;
+				});
+
+				if (accepted) {
+					loc.add(v);
+					radii.push_back(r);
+					*outputIter++ = v;
+					++valids;
+				}
+
+				if (n % 5000 == 0) {
+					BBN_LOG("Dart throwing %.2f%% - Found %d in %d attempts\r",
+						(float)n / _n * 100, valids, (int)n);
+				}
+
+				if (monitor.saturated(accepted))
+					break;
+			}
+
+			BBN_LOG("Dart throwing 100.00%% - Found %d in %d attempts\n",
+				valids, (int)n);
+
+			_stopReason = monitor.reason;
+			return valids > 0;
+		}
+
+		/** Resample aiming at the given number of samples by searching the conflict radius.
+
+			The conflict radius is adapted until the number of samples is within tolerance * nTarget of nTarget or the
+			maximum number of probes is reached. The search starts from the current conflict radius and the radius
+			of the sample set closest to the target is kept as the new conflict radius.
+
+			Darts are drawn once and cached, every probe throws the same darts in the same order. A probe with a
+			smaller radius than a probe that yielded too few samples starts from the samples accepted by that probe,
+			as they are conflict free for the smaller radius as well. */
+		template<typename SamplerFnc, typename VectorOutputIterator>
+		bool resampleToCount(SamplerFnc &sampler, size_t nTarget, float tolerance, VectorOutputIterator outputIter)
+		{
+			if (nTarget == 0)
+				return false;
+
+			const Scalar dims = Scalar(std::max<typename Vector::Index>(_traits.getStackedDims(), 1));
+			const Scalar target = Scalar(nTarget);
+
+			ArrayOfVector darts;
+			std::vector<size_t> accepted, seed, best;
+			Scalar bestRadius = _conflictRadius;
+			StopReason bestReason = StopNotRun;
+
+			// Bracket of radii yielding too many (lower) and too few (upper) samples.
+			Scalar lowerRadius = 0, upperRadius = 0;
+			size_t lowerCount = 0, upperCount = 0;
+			Scalar prevRadius = 0;
+			size_t prevCount = 0;
+
+			Scalar r = _conflictRadius;
+			for (int probe = 0; probe < _maxProbes; ++probe) {
+				throwCachedDarts(sampler, darts, r, seed, accepted);
+				const size_t count = accepted.size();
+
+				BBN_LOG("Dart throwing probe %d - Radius %.5f - Found %d samples\n", probe, (float)r, (int)count);
+
+				if (best.empty() || absDiff(count, nTarget) < absDiff(best.size(), nTarget)) {
+					best = accepted;
+					bestRadius = r;
+					bestReason = _stopReason;
+				}
+
+				if (Scalar(absDiff(count, nTarget)) <= Scalar(tolerance) * target)
+					break;
+
+				if (count < nTarget) {
+					upperRadius = r;
+					upperCount = count;
+					seed = accepted;
+				} else {
+					lowerRadius = r;
+					lowerCount = count;
+				}
+
+				// Next radius by interpolation in log-log space. Until the target is bracketed, the number of samples
+				// is extrapolated along the slope observed between the last two probes, or assumed to scale with
+				// r^-dims over the stacked dimensions. The radius changes at most by a factor of two per probe then,
+				// as samples may cover fewer dimensions and the slope flattens towards saturation.
+				Scalar next;
+				if (lowerRadius > 0 && upperRadius > 0) {
+					next = std::sqrt(lowerRadius * upperRadius);
+					if (upperCount > 0 && lowerCount > upperCount) {
+						const Scalar t = (std::log(target) - std::log(Scalar(lowerCount))) / (std::log(Scalar(upperCount)) - std::log(Scalar(lowerCount)));
+						const Scalar interpolated = lowerRadius * std::pow(upperRadius / lowerRadius, t);
+						if (interpolated > lowerRadius && interpolated < upperRadius) {
+							next = interpolated;
+						}
+					}
+				} else if (count == 0) {
+					next = r * Scalar(0.5);
+				} else {
+					Scalar exponent = dims;
+					if (prevCount > 0 && prevCount != count) {
+						const Scalar slope = (std::log(Scalar(prevCount)) - std::log(Scalar(count))) / (std::log(r) - std::log(prevRadius));
+						if (slope > 0) {
+							exponent = slope;
+						}
+					}
+					const Scalar scale = std::pow(Scalar(count) / target, Scalar(1) / exponent);
+					next = r * std::min(std::max(scale, Scalar(0.5)), Scalar(2));
+				}
+
+				prevRadius = r;
+				prevCount = count;
+				r = next;
+			}
+
+			_conflictRadius = bestRadius;
+			_stopReason = bestReason;
+
+			for (size_t i = 0; i < best.size(); ++i) {
+				*outputIter++ = darts[best[i]];
+			}
+
+			return !best.empty();
+		}
+
+		/** Maximal Poisson-disk sampling of the box [lower, upper] spanned by the positional dimensions.
+		
+			Instead of drawing darts from a sampler, darts are placed uniformly into cells of the domain that are not yet
+			covered by the conflict radius of an accepted sample. Their positions are turned into stacked vectors by
+			the lift function, which receives a PositionVector and returns a Vector. Cells start with a diagonal of the 
+			conflict radius, so that any accepted sample covers its cell. After each pass of one dart per active cell,
+			covered cells are removed and the remaining ones are split in halves along each dimension. Sampling ends
+			once no active cells remain, yielding a maximal sample set, or after the maximum number of subdivisions.
+
+			Coverage is determined along the positional dimensions. Without feature dimensions the result is maximal,
+			with features it is maximal with respect to the positional block. Darts are still tested for conflicts
+			using the stacked distance. */
+		template<typename LiftFnc, typename VectorOutputIterator>
+		bool resampleMaximal(const PositionVector &lower, const PositionVector &upper, LiftFnc &lift, VectorOutputIterator outputIter)
+		{
+			typedef typename PositionVector::Index Index;
+
+			typename Traits::Locator loc(_traits.getLocatorParams());
+			loc.prepare(_conflictRadius);
+			KdTreeLocator<PositionVector> positionLoc;
+			std::mt19937 gen(_seed);
+			std::uniform_real_distribution<Scalar> uniform(0, 1);
+
+			const Index posDims = lower.rows();
+			const Scalar r2 = _conflictRadius * _conflictRadius;
+
+			// Initial cells with a diagonal of the conflict radius.
+			const Scalar baseSize = _conflictRadius / std::sqrt(Scalar(posDims));
+			std::vector<int> counts(posDims);
+			for (Index d = 0; d < posDims; ++d) {
+				counts[d] = std::max(static_cast<int>(std::ceil((upper(d) - lower(d)) / baseSize)), 1);
+			}
+
+			std::vector<int> cells, nextCells;
+			std::vector<int> c(posDims, 0);
+			for (bool more = true; more;) {
+				cells.insert(cells.end(), c.begin(), c.end());
+				more = false;
+				for (Index d = 0; d < posDims && !more; ++d) {
+					if (++c[d] < counts[d]) {
+						more = true;
+					} else {
+						c[d] = 0;
+					}
+				}
+			}
+
+			std::vector<size_t> order;
+			std::vector<size_t> neighborIds;
+			std::vector<Scalar> neighborDists2;
+			PositionVector cellLower(posDims), cellUpper(posDims), p(posDims);
+
+			int valids = 0;
+			size_t attempts = 0;
+			int level = 0;
+			Scalar cellSize = baseSize;
+			_stopReason = StopCoverageComplete;
+
+			while (!cells.empty()) {
+				const size_t nCells = cells.size() / posDims;
+
+				// Throw one dart into each active cell in random order.
+				order.resize(nCells);
+				for (size_t i = 0; i < nCells; ++i) {
+					order[i] = i;
+				}
+				std::shuffle(order.begin(), order.end(), gen);
+
+				for (size_t i = 0; i < nCells; ++i) {
+					const int *cell = &cells[order[i] * posDims];
+					for (Index d = 0; d < posDims; ++d) {
+						const Scalar l = lower(d) + Scalar(cell[d]) * cellSize;
+						p(d) = l + uniform(gen) * (std::min(l + cellSize, upper(d)) - l);
+					}
+
+					const Vector v = lift(p);
+					++attempts;
+
+					if (!loc.findAnyWithinRadius(v, _conflictRadius)) {
+						loc.add(v);
+						positionLoc.add(p);
+						*outputIter++ = v;
+						++valids;
+					}
+				}
+
+				BBN_LOG("Dart throwing level %d - %d active cells - Found %d in %d attempts\r",
+					level, (int)nCells, valids, (int)attempts);
+
+				if (level == _maxSubdivisions) {
+					_stopReason = StopMaximumSubdivisions;
+					break;
+				}
+
+				// Split uncovered cells and keep uncovered children.
+				const Scalar childSize = cellSize * Scalar(0.5);
+				const size_t nChildren = size_t(1) << posDims;
+
+				nextCells.clear();
+				for (size_t i = 0; i < nCells; ++i) {
+					const int *cell = &cells[i * posDims];
+					for (Index d = 0; d < posDims; ++d) {
+						cellLower(d) = lower(d) + Scalar(cell[d]) * cellSize;
+						cellUpper(d) = std::min(cellLower(d) + cellSize, upper(d));
+					}
+
+					if (isCovered(positionLoc, cellLower, cellUpper, r2, neighborIds, neighborDists2))
+						continue;
+
+					for (size_t k = 0; k < nChildren; ++k) {
+						for (Index d = 0; d < posDims; ++d) {
+							c[d] = 2 * cell[d] + static_cast<int>((k >> d) & 1);
+							cellLower(d) = lower(d) + Scalar(c[d]) * childSize;
+							cellUpper(d) = std::min(cellLower(d) + childSize, upper(d));
+						}
+
+						// Skip children outside of the domain and covered children.
+						if (((cellUpper - cellLower).array() <= 0).any())
+							continue;
+
+						if (isCovered(positionLoc, cellLower, cellUpper, r2, neighborIds, neighborDists2))
+							continue;
+
+						nextCells.insert(nextCells.end(), c.begin(), c.end());
+					}
+				}
+
+				cells.swap(nextCells);
+				cellSize = childSize;
+				++level;
+			}
+
+			BBN_LOG("Dart throwing 100.00%% - Found %d in %d attempts\n",
+				valids, (int)attempts);
+
+			return valids > 0;
+		}
+
     private:
+
+		typedef std::vector<Vector, Eigen::aligned_allocator<Vector> > ArrayOfVector;
+
+		/* Sequential dart throwing over cached darts with the given radius. Darts are drawn from the sampler when
+		   the cache is exhausted. The seed darts are accepted upfront. */
+		template<typename SamplerFnc>
+		void throwCachedDarts(SamplerFnc &sampler, ArrayOfVector &darts, Scalar r, const std::vector<size_t> &seed, std::vector<size_t> &accepted)
+		{
+			typename Traits::Locator loc(_traits.getLocatorParams());
+			loc.prepare(r);
+			SaturationMonitor monitor(*this);
+
+			std::vector<char> seeded(darts.size(), 0);
+			accepted = seed;
+			for (size_t i = 0; i < seed.size(); ++i) {
+				loc.add(darts[seed[i]]);
+				seeded[seed[i]] = 1;
+			}
+
+			for (size_t n = 0; n < _n; ++n) {
+				if (n == darts.size()) {
+					darts.push_back(sampler());
+					seeded.push_back(0);
+				} else if (seeded[n]) {
+					continue;
+				}
+
+				const bool valid = !loc.findAnyWithinRadius(darts[n], r);
+				if (valid) {
+					loc.add(darts[n]);
+					accepted.push_back(n);
+				}
+
+				if (monitor.saturated(valid))
+					break;
+			}
+
+			_stopReason = monitor.reason;
+		}
+
+		/* Absolute difference of unsigned values. */
+		static size_t absDiff(size_t a, size_t b)
+		{
+			return a > b ? a - b : b - a;
+		}
+
+		/* Test if the box of a cell is entirely within the conflict radius of an accepted sample, i.e if the corner
+		   of the box farthest away from the sample is within the conflict radius. */
+		static bool isCovered(const KdTreeLocator<PositionVector> &positionLoc, const PositionVector &boxLower, const PositionVector &boxUpper, Scalar r2,
+			std::vector<size_t> &neighborIds, std::vector<Scalar> &neighborDists2)
+		{
+			const PositionVector center = Scalar(0.5) * (boxLower + boxUpper);
+			const PositionVector halfSize = Scalar(0.5) * (boxUpper - boxLower);
+			const Scalar halfDiagonal = halfSize.norm();
+			const Scalar r = std::sqrt(r2);
+
+			// Any sample close to the center covers the box.
+			if (r > halfDiagonal && positionLoc.findAnyWithinRadius(center, r - halfDiagonal))
+				return true;
+
+			if (!positionLoc.findAllWithinRadius(center, r + halfDiagonal, neighborIds, neighborDists2))
+				return false;
+
+			for (size_t i = 0; i < neighborIds.size(); ++i) {
+				const PositionVector far = (positionLoc.get(neighborIds[i]) - center).cwiseAbs() + halfSize;
+				if (far.squaredNorm() <= r2)
+					return true;
+			}
+
+			return false;
+		}
+
+		/* Tracks the outcome of attempts to detect when no more samples fit. */
+		struct SaturationMonitor {
+			SaturationMonitor(const DartThrowing &dt)
+				:maxFailures(dt._maxFailures), minRate(dt._minAcceptanceRate), window(dt._acceptanceWindow),
+				 failures(0), windowAttempts(0), windowAccepted(0), reason(StopMaximumAttempts)
+			{}
+
+			/* Record the outcome of an attempt. Returns true when a stopping criterion is met. */
+			bool saturated(bool accepted)
+			{
+				failures = accepted ? 0 : failures + 1;
+				if (maxFailures > 0 && failures >= maxFailures) {
+					reason = StopConsecutiveFailures;
+					return true;
+				}
+
+				if (minRate > 0) {
+					windowAccepted += accepted ? 1 : 0;
+					if (++windowAttempts == window) {
+						const Scalar rate = Scalar(windowAccepted) / Scalar(window);
+						windowAttempts = windowAccepted = 0;
+						if (rate < minRate) {
+							reason = StopAcceptanceRate;
+							return true;
+						}
+					}
+				}
+
+				return false;
+			}
+
+			/* Number of attempts after which stopping criteria should be evaluated at the latest. */
+			size_t horizon() const
+			{
+				size_t h = std::numeric_limits<size_t>::max();
+				if (maxFailures > 0) h = std::min(h, maxFailures);
+				if (minRate > 0) h = std::min(h, window);
+				return h;
+			}
+
+			size_t maxFailures;
+			Scalar minRate;
+			size_t window;
+			size_t failures, windowAttempts, windowAccepted;
+			StopReason reason;
+		};
+
+		/* Parallel dart throwing using phase groups (Wei 2008). Darts are drawn in rounds and binned into cells
+		   of twice the conflict radius along the positional dimensions. Cells whose coordinates share the same
+		   parities form a phase. Any two cells of a phase are separated by at least one cell, so darts within
+		   different cells of a phase cannot conflict with each other and are accepted concurrently. Each dart is
+		   tested against all darts accepted in previous phases and against darts accepted before it in its own
+		   cell, which guarantees the same minimum distance as sequential dart throwing.
+
+		   Stopping criteria are evaluated in drawing order after each round. Rounds are therefore kept no longer
+		   than the number of attempts the criteria need to trigger. */
+		template<typename SamplerFnc, typename VectorOutputIterator>
+		bool resampleParallel(SamplerFnc &sampler, VectorOutputIterator outputIter)
+		{
+			typename Traits::Locator loc(_traits.getLocatorParams());
+			loc.prepare(_conflictRadius);
+
+			const typename Vector::Index posDims = _traits.getPositionDims();
+			const Scalar invCellSize = Scalar(1) / (Scalar(2) * _conflictRadius);
+			const Scalar r2 = _conflictRadius * _conflictRadius;
+			const size_t nPhases = size_t(1) << posDims;
+			const size_t nRounds = 16;
+
+			SaturationMonitor monitor(*this);
+			const size_t roundSize = std::max<size_t>(std::min(_n / nRounds + 1, monitor.horizon()), 1);
+
+			ArrayOfVector darts;
+			std::vector<int> keys;
+			std::vector<size_t> phaseOf, order, cellBegin;
+			std::vector<char> accepted;
+
+			int valids = 0;
+			size_t n = 0;
+			bool saturated = false;
+			while (n < _n && !saturated) {
+				const size_t nDarts = std::min(_n - n, roundSize);
+
+				// Draw darts sequentially, as samplers are not required to be thread-safe.
+				darts.resize(nDarts);
+				keys.resize(nDarts * posDims);
+				phaseOf.resize(nDarts);
+				order.resize(nDarts);
+				accepted.assign(nDarts, 0);
+				for (size_t i = 0; i < nDarts; ++i) {
+					darts[i] = sampler();
+					phaseOf[i] = 0;
+					for (typename Vector::Index d = 0; d < posDims; ++d) {
+						const int c = static_cast<int>(std::floor(darts[i](d) * invCellSize));
+						keys[i * posDims + d] = c;
+						phaseOf[i] |= size_t(c & 1) << d;
+					}
+					order[i] = i;
+				}
+				n += nDarts;
+
+				// Group darts by phase and cell, keeping the order of drawing within cells.
+				std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+					if (phaseOf[a] != phaseOf[b])
+						return phaseOf[a] < phaseOf[b];
+					const int *ka = &keys[a * posDims];
+					const int *kb = &keys[b * posDims];
+					for (typename Vector::Index d = 0; d < posDims; ++d) {
+						if (ka[d] != kb[d])
+							return ka[d] < kb[d];
+					}
+					return a < b;
+				});
+
+				cellBegin.clear();
+				for (size_t i = 0; i < nDarts; ++i) {
+					if (i == 0 || phaseOf[order[i]] != phaseOf[order[i - 1]] ||
+						!std::equal(&keys[order[i] * posDims], &keys[order[i] * posDims] + posDims, &keys[order[i - 1] * posDims]))
+					{
+						cellBegin.push_back(i);
+					}
+				}
+				cellBegin.push_back(nDarts);
+
+				size_t firstCell = 0;
+				for (size_t phase = 0; phase < nPhases && firstCell + 1 < cellBegin.size(); ++phase) {
+					size_t lastCell = firstCell;
+					while (lastCell + 1 < cellBegin.size() && phaseOf[order[cellBegin[lastCell]]] == phase) {
+						++lastCell;
+					}
+
+					if (lastCell == firstCell)
+						continue;
+
+					detail::parallelFor(lastCell - firstCell, _nThreads, [&](size_t c) {
+						const size_t begin = cellBegin[firstCell + c];
+						const size_t end = cellBegin[firstCell + c + 1];
+						for (size_t i = begin; i < end; ++i) {
+							const Vector &v = darts[order[i]];
+							if (loc.findAnyWithinRadius(v, _conflictRadius))
+								continue;
+
+							bool conflict = false;
+							for (size_t j = begin; j < i && !conflict; ++j) {
+								conflict = accepted[order[j]] && (darts[order[j]] - v).squaredNorm() <= r2;
+							}
+							accepted[order[i]] = !conflict;
+						}
+					});
+
+					for (size_t i = cellBegin[firstCell]; i < cellBegin[lastCell]; ++i) {
+						if (accepted[order[i]]) {
+							loc.add(darts[order[i]]);
+							*outputIter++ = darts[order[i]];
+							++valids;
+						}
+					}
+
+					firstCell = lastCell;
+				}
+
+				for (size_t i = 0; i < nDarts && !saturated; ++i) {
+					saturated = monitor.saturated(accepted[i] != 0);
+				}
+
+				BBN_LOG("Dart throwing %.2f%% - Found %d in %d attempts\r",
+					(float)n / _n * 100, valids, (int)n);
+			}
+
+			BBN_LOG("Dart throwing 100.00%% - Found %d in %d attempts\n",
+				valids, (int)n);
+
+			_stopReason = monitor.reason;
+			return valids > 0;
+		}
         
         Scalar _conflictRadius;
         size_t _n;
+		int _nThreads;
+		size_t _maxFailures;
+		Scalar _minAcceptanceRate;
+		size_t _acceptanceWindow;
+		StopReason _stopReason;
+		int _maxSubdivisions;
+		unsigned _seed;
+		int _maxProbes;
+		size_t _blockSize;
 		Traits _traits;
     };
 }
@@ -18,7 +18,13 @@
 
 #include <Eigen/Dense>
 #include <vector>
+#include <algorithm>
+#include <type_traits>
 #include <bbn/task_traits.h>
+#include <bbn/bucketing.h>
+#include <bbn/parallel.h>
+#include <bbn/fast_exp.h>
+#include <bbn/neighbor_lists.h>
 #include <bbn/util.h>
 
 namespace bbn {
@@ -32,12 +38,39 @@ namespace bbn {
 		typedef typename Traits::Vector Vector;
 		typedef typename Traits::Matrix Matrix;
 		typedef typename Traits::Locator Locator;
+
+		/** Schedules adapting the step size between iterations. Adapted step sizes are limited to MaxStepGrowth
+			times the step size. */
+		enum StepSchedule {
+			FixedStep,				/** Keep the step size constant. */
+			BoldDriverStep,			/** Grow the step size while the energy decreases. Steps that increase the energy are
+										retried with half the step size. */
+			BarzilaiBorweinStep		/** Derive the step size from the change of positions and gradients (Barzilai-Borwein). */
+		};
+
+		enum {
+			MaxStepGrowth = 10,		/** Largest factor adapted step sizes may exceed the step size by. */
+			SettleIterations = 2	/** Consecutive iterations of small displacement after which samples become inactive. */
+		};
+
+		/** Reasons for minimization to stop. */
+		enum StopReason {
+			StopNotRun,				/** Minimization has not been run yet. */
+			StopMaximumIterations,	/** The maximum number of iterations was reached. */
+			StopEnergyDecrease,		/** The relative change of energy dropped below the minimum. */
+			StopDisplacement,		/** The largest displacement of a sample dropped below the minimum. */
+			StopNoActiveSamples		/** All samples settled in active set mode. */
+		};
 		
         /** Default constructor. */
 		EnergyMinimization()
 			: _sigma(Scalar(0.03f)),
 			  _stepSize(Scalar(0.03f) * _sigma * _sigma),
-			  _maxSearchRadius(Scalar(0.03f) * Scalar(2.576))
+			  _maxSearchRadius(Scalar(0.03f) * Scalar(2.576)),
+			  _nThreads(1), _constraintThreadSafe(false), _symmetricPairs(false),
+			  _kernelMaxRelativeError(0), _skin(0),
+			  _minRelativeEnergyDecrease(0), _minDisplacement(0), _stepSchedule(FixedStep),
+			  _activeSetThreshold(0), _iterations(0), _kernelEvaluations(0), _energy(0), _stopReason(StopNotRun)
         {}        
         
         /* Set the conflict radius that determines the resampling resolution. */
@@ -55,12 +88,77 @@ namespace bbn {
 			_maxSearchRadius = s;
 		}
        
+		/** Set the number of threads used per iteration. Non-positive values use all hardware threads. Defaults to one. */
+		void setNumberOfThreads(int n) {
+			_nThreads = n;
+		}
+
+		/** Declare whether the constrain function may be invoked concurrently. Defaults to false. */
+		void setConstraintThreadSafe(bool threadSafe) {
+			_constraintThreadSafe = threadSafe;
+		}
+
+		/** Evaluate each pair of neighboring samples once instead of once per sample. Disabled by default. */
+		void setSymmetricPairs(bool enable) {
+			_symmetricPairs = enable;
+		}
+
+		/** Approximate exp in the Gaussian kernel with the given maximum relative error. Zero, the default, disables. */
+		void setKernelApproximation(Scalar maxRelativeError) {
+			_kernelMaxRelativeError = maxRelativeError;
+		}
+
+		/** Reuse neighbor lists gathered with the search radius enlarged by skin across iterations. Zero, the default, disables. */
+		void setNeighborListSkin(Scalar skin) {
+			_skin = skin;
+		}
+
+		/** Stop once the energy changes by less than the given fraction between iterations. Zero, the default, disables. */
+		void setMinimumRelativeEnergyDecrease(Scalar fraction) {
+			_minRelativeEnergyDecrease = fraction;
+		}
+
+		/** Stop once no sample moves by more than the given distance in an iteration. Zero, the default, disables. */
+		void setMinimumDisplacement(Scalar d) {
+			_minDisplacement = d;
+		}
+
+		/** Set the schedule adapting the step size between iterations, starting from the step size. Defaults to FixedStep. */
+		void setStepSchedule(StepSchedule s) {
+			_stepSchedule = s;
+		}
+
+		/** Skip samples that moved less than the given distance in SettleIterations iterations. Zero, the default, disables. */
+		void setActiveSetThreshold(Scalar d) {
+			_activeSetThreshold = d;
+		}
+
+		/** Number of iterations performed by the last call to minimize. */
+		size_t getIterations() const {
+			return _iterations;
+		}
+
+		/** Number of kernel evaluations, i.e. visited pairs of neighbors, of the last call to minimize. */
+		size_t getKernelEvaluations() const {
+			return _kernelEvaluations;
+		}
+
+		/** Total energy of the samples evaluated in the last iteration of the last call to minimize. */
+		Scalar getEnergy() const {
+			return _energy;
+		}
+
+		/** Reason the last call to minimize stopped. */
+		StopReason getStopReason() const {
+			return _stopReason;
+		}
+
 		/* Set parameters specific to traits. */
 		void setTaskTraits(const Traits &t) {
 			_traits = t;
 		}
 
-        /** Minimize samples based on energy formulation. */
+        /** Minimize samples based on energy formulation. Performs at most nIterations iterations. */
 		template<typename ConstrainFnc, typename VectorInputIterator, typename VectorOutputIterator>
 		bool minimize(VectorInputIterator samplesBegin,
 					  VectorInputIterator samplesEnd,
@@ -73,10 +171,12 @@ namespace bbn {
 			if (nElements == 0)
 				return false;
 
+			// Neighbor lists are built with the larger radius, direct queries with the search radius.
 			typename Traits::Locator loc(_traits.getLocatorParams());
+			loc.prepare(_maxSearchRadius + _skin);
 			typename Traits::Matrix positions[2] = {
-				Traits::Matrix(_traits.getStackedDims(), nElements),
-				Traits::Matrix(_traits.getStackedDims(), nElements)
+				Matrix(_traits.getStackedDims(), nElements),
+				Matrix(_traits.getStackedDims(), nElements)
 			};
 
 			
@@ -84,13 +184,60 @@ namespace bbn {
 			VectorInputIterator sampleIter = samplesBegin;
 			for (size_t i = 0; i != nElements; ++i) {
 				positions[0].col(i) = *sampleIter;
-				positions[1].col(i) = *sampleIter;
 				++sampleIter;
 			}
 
+			// Pairs are shared between samples of a chunk only. Samples are therefore processed along a Z-order curve
+			// through buckets of the search radius, so that most neighbors of a sample fall into its chunk. Samples
+			// move little, the order is kept for all iterations.
+			std::vector<size_t> order;
+			if (_symmetricPairs) {
+				detail::Bucketing<Vector>::zOrder(positions[0], _traits.getPositionDims(),
+					typename detail::Bucketing<Vector>::Resolution(_maxSearchRadius), order);
+				for (size_t i = 0; i != nElements; ++i) {
+					positions[1].col(i) = positions[0].col(order[i]);
+				}
+				positions[0] = positions[1];
+			} else {
+				positions[1] = positions[0];
+			}
+
+			// Kernel arguments are bounded by the search radius.
+			_kernelExp = detail::ExpApproximation<Scalar>(
+				Scalar(-0.5) * _maxSearchRadius * _maxSearchRadius / (_sigma * _sigma), _kernelMaxRelativeError);
+
+			// Samples are processed in chunks. Energies are kept per sample.
+			const size_t chunkSize = 256;
+			const size_t nChunks = (nElements + chunkSize - 1) / chunkSize;
+			std::vector<Scalar> sampleEnergies(nElements, Scalar(0));
+			PairBuffers pairBuffers;
+
+			// Samples whose energy is evaluated, samples that moved in the last iteration and the number of
+			// consecutive iterations samples moved less than the active set threshold.
+			const bool useActiveSet = _activeSetThreshold > 0;
+			std::vector<char> active(nElements, 1), moved(nElements, 1);
+			std::vector<unsigned char> calm(nElements, 0);
+			size_t nActive = nElements;
+
+			// Neighbor lists and the positions they were built from.
+			const bool cacheNeighbors = _skin > 0;
+			NeighborLists<Scalar> neighborLists;
+			Matrix listPositions;
+
+			// Gradients of the current and previous iteration, adapted step size. Energies and active samples of the
+			// previous iteration are kept to retry rejected steps.
+			Matrix gradients, prevGradients;
+			std::vector<Scalar> prevSampleEnergies;
+			std::vector<char> prevActive;
+			Scalar stepSize = _stepSize;
+			Scalar prevEnergy = 0;
+			_iterations = 0;
+			_kernelEvaluations = 0;
+			std::vector<size_t> chunkEvaluations(nChunks, 0);
+			_stopReason = StopMaximumIterations;
+
 			// Loop
 			int index = 0, nextIndex = 1;
-			Vector gradient;
 			Scalar totalEnergy = 0;
 			for (size_t iter = 0; iter < nIterations; ++iter) {
 
@@ -98,38 +245,235 @@ namespace bbn {
 				Matrix &nextPositions = positions[nextIndex];
 				
 				// Build locator for modified elements
-				loc.reset();
-				for (size_t i = 0; i < nElements; ++i) {
-					loc.add(curPositions.col(i));
+				bool rebuildLists = cacheNeighbors;
+				if (iter == 0) {
+					loc.build(curPositions);
+				} else if (cacheNeighbors) {
+					// No pair can enter the search radius before a sample moved by more than half the skin.
+					const Scalar halfSkin = _skin * Scalar(0.5);
+					rebuildLists = (curPositions - listPositions).colwise().squaredNorm().maxCoeff() > halfSkin * halfSkin;
+					if (rebuildLists) {
+						updateLocator(loc, curPositions, std::integral_constant<bool, detail::LocatorSupportsUpdate<Locator>::value != 0>());
+					}
+				} else {
+					updateLocator(loc, curPositions, std::integral_constant<bool, detail::LocatorSupportsUpdate<Locator>::value != 0>());
 				}
 
-				// For each element
-				totalEnergy = 0;				
+				if (rebuildLists) {
+					neighborLists = findAllWithinRadiusBatch(loc, curPositions, _maxSearchRadius + _skin, _nThreads);
+					listPositions = curPositions;
+				}
+
+				const LocatorNeighbors locatorNeighbors = { loc, _maxSearchRadius };
+				const ListNeighbors listNeighbors = { neighborLists, curPositions, _maxSearchRadius * _maxSearchRadius };
+
+				// Samples that settled stay inactive unless a neighbor moved. Neighborhoods are searched from the
+				// smaller of both sets, either activating neighbors of moved samples or testing settled samples.
+				if (useActiveSet && iter > 0) {
+					for (size_t i = 0; i < nElements; ++i) {
+						active[i] = calm[i] < SettleIterations;
+					}
+					const size_t nMoved = static_cast<size_t>(std::count(moved.begin(), moved.end(), 1));
+					if (nMoved <= nElements - nMoved) {
+						for (size_t j = 0; j < nElements; ++j) {
+							if (!moved[j])
+								continue;
+
+							auto activate = [&](size_t id, Scalar) {
+								active[id] = 1;
+								return true;
+							};
+
+							if (cacheNeighbors) {
+								listNeighbors(j, activate);
+							} else {
+								locatorNeighbors(j, activate);
+							}
+						}
+					} else {
+						auto processChunk = [&](size_t c) {
+							const size_t end = std::min(nElements, (c + 1) * chunkSize);
+							for (size_t i = c * chunkSize; i < end; ++i) {
+								if (active[i])
+									continue;
+
+								auto testMoved = [&](size_t id, Scalar) {
+									active[i] = moved[id];
+									return !moved[id];
+								};
+
+								if (cacheNeighbors) {
+									listNeighbors(i, testMoved);
+								} else {
+									locatorNeighbors(i, testMoved);
+								}
+							}
+						};
+
+						detail::parallelFor(nChunks, _nThreads, processChunk);
+					}
+
+					nActive = static_cast<size_t>(std::count(active.begin(), active.end(), 1));
+					if (nActive == 0) {
+						_stopReason = StopNoActiveSamples;
+						break;
+					}
+				}
+
+				// Determine energy gradients of all elements upfront when visiting pairs. Larger chunks share more pairs.
+				if (_symmetricPairs) {
+					if (cacheNeighbors) {
+						pairEnergies(curPositions, listNeighbors, active, 4 * chunkSize, pairBuffers, chunkEvaluations);
+					} else {
+						pairEnergies(curPositions, locatorNeighbors, active, 4 * chunkSize, pairBuffers, chunkEvaluations);
+					}
+
+					for (size_t i = 0; i < nElements; ++i) {
+						if (active[i]) {
+							sampleEnergies[i] = pairBuffers.energies[i];
+						}
+					}
+				}
+
+				// Determine energy gradient of each element as described in equation 14.
+				if (!_symmetricPairs) {
+					gradients.resize(curPositions.rows(), curPositions.cols());
+
+					auto processChunk = [&](size_t c) {
+						Vector gradient;
+
+						const size_t end = std::min(nElements, (c + 1) * chunkSize);
+						for (size_t i = c * chunkSize; i < end; ++i) {
+							if (!active[i])
+								continue;
+
+							sampleEnergies[i] = cacheNeighbors ?
+								energy(i, curPositions, listNeighbors, gradient, chunkEvaluations[c]) :
+								energy(i, curPositions, locatorNeighbors, gradient, chunkEvaluations[c]);
+							gradients.col(i) = gradient;
+						}
+					};
+
+					detail::parallelFor(nChunks, _nThreads, processChunk);
+				}
+
+				const Matrix &curGradients = _symmetricPairs ? pairBuffers.gradients : gradients;
+
+				// Reduce in sample order, so that the total energy does not depend on the number of threads. Inactive
+				// samples contribute the energy of their last evaluation.
+				totalEnergy = 0;
 				for (size_t i = 0; i < nElements; ++i) {
+					totalEnergy += sampleEnergies[i];
+				}
 
-					// Determine energy gradient as described in equation 14.
+				BBN_LOG("Energy minimization %.2f%% - Total energy %.2f - %d active\r",
+					(float)iter / nIterations * 100, totalEnergy, (int)nActive);
 
-					totalEnergy += energy(i, loc, gradient);
-					
-					// Move sample position / feature
-					nextPositions.col(i) = curPositions.col(i);
-					nextPositions.col(i).topRows(_traits.getPositionDims()) -= _stepSize * gradient.topRows(_traits.getPositionDims());
+				// Bold driver rejects steps that increased the energy and retries the step of the last iteration from
+				// its positions with half the step size. Next positions still hold the positions of the last iteration.
+				const bool retry = _stepSchedule == BoldDriverStep && iter > 0 && totalEnergy > prevEnergy;
+				if (retry) {
+					curPositions = nextPositions;
+					sampleEnergies = prevSampleEnergies;
+					totalEnergy = prevEnergy;
+					stepSize *= Scalar(0.5);
+				} else {
+					// Stop once the energy of the current positions barely changed.
+					if (iter > 0 && _minRelativeEnergyDecrease > 0 &&
+						std::abs(prevEnergy - totalEnergy) < _minRelativeEnergyDecrease * std::abs(prevEnergy))
+					{
+						_stopReason = StopEnergyDecrease;
+						break;
+					}
 
-					// Constrain sample position / feature
-					fnc(nextPositions.col(i));
+					// Adapt step size.
+					if (iter > 0) {
+						stepSize = nextStepSize(stepSize, totalEnergy, prevEnergy, curPositions, nextPositions, curGradients, prevGradients);
+					}
+					if (_stepSchedule != FixedStep) {
+						prevGradients = curGradients;
+					}
+					if (_stepSchedule == BoldDriverStep) {
+						prevSampleEnergies = sampleEnergies;
+						prevActive = active;
+					}
+					prevEnergy = totalEnergy;
 				}
 
-				BBN_LOG("Energy minimization %.2f%% - Total energy %.2f\r",
-					(float)iter / nIterations * 100, totalEnergy);
+				const Matrix &stepGradients = retry ? prevGradients : curGradients;
+				const std::vector<char> &moving = retry ? prevActive : active;
+
+				// For each element
+				const typename Vector::Index posDims = _traits.getPositionDims();
+				detail::parallelFor(nChunks, _nThreads, [&](size_t c) {
+					const size_t end = std::min(nElements, (c + 1) * chunkSize);
+					for (size_t i = c * chunkSize; i < end; ++i) {
+
+						// Move sample position / feature
+						nextPositions.col(i) = curPositions.col(i);
+						if (!moving[i])
+							continue;
+
+						nextPositions.col(i).topRows(posDims) -= stepSize * stepGradients.col(i).topRows(posDims);
+
+						// Constrain sample position / feature
+						if (_constraintThreadSafe) {
+							fnc(nextPositions.col(i));
+						}
+					}
+				});
+
+				if (!_constraintThreadSafe) {
+					for (size_t i = 0; i < nElements; ++i) {
+						if (moving[i]) {
+							fnc(nextPositions.col(i));
+						}
+					}
+				}
 
+				++_iterations;
 				index = nextIndex;
 				nextIndex = (nextIndex + 1) % 2;
+
+				// Displacements of steps below the configured step size are measured at the configured step size,
+				// so that shrinking adapted steps do not settle samples that are still far from equilibrium.
+				if (useActiveSet) {
+					const Scalar scale = std::max(Scalar(1), _stepSize / stepSize);
+					const Scalar threshold2 = _activeSetThreshold * _activeSetThreshold;
+					for (size_t i = 0; i < nElements; ++i) {
+						if (!moving[i]) {
+							moved[i] = 0;
+							continue;
+						}
+
+						moved[i] = (positions[index].col(i) - positions[nextIndex].col(i)).squaredNorm() * scale * scale >= threshold2;
+						calm[i] = moved[i] ? 0 : static_cast<unsigned char>(std::min<int>(calm[i] + 1, SettleIterations));
+					}
+				}
+
+				// Stop once no sample moved noticeably.
+				if (_minDisplacement > 0 &&
+					(positions[index] - positions[nextIndex]).colwise().squaredNorm().maxCoeff() < _minDisplacement * _minDisplacement)
+				{
+					_stopReason = StopDisplacement;
+					break;
+				}
 			}
 
 			BBN_LOG("Energy minimization 100.00%% - Total energy %.2f\n", totalEnergy);
+			_energy = totalEnergy;
+			for (size_t c = 0; c < nChunks; ++c) {
+				_kernelEvaluations += chunkEvaluations[c];
+			}
+
+			// Restore the input order.
+			std::vector<size_t> rank(order.size());
+			for (size_t i = 0; i != order.size(); ++i) {
+				rank[order[i]] = i;
+			}
 
 			for (size_t i = 0; i != nElements; ++i) {
-				*refinedSamplesIter++ = positions[index].col(i);
+				*refinedSamplesIter++ = positions[index].col(rank.empty() ? i : rank[i]);
 			}
 
 			return true;
@@ -138,37 +482,212 @@ namespace bbn {
         
     private:
 
-		Scalar energy(size_t queryIndex, const Locator &loc, Vector &gradient) const
+		/* Step size of the next iteration according to the step schedule. */
+		Scalar nextStepSize(Scalar stepSize, Scalar energy, Scalar prevEnergy,
+			const Matrix &positions, const Matrix &prevPositions, const Matrix &gradients, const Matrix &prevGradients) const
 		{
-			gradient = Vector::Zero(loc.dims());
-			Scalar energy = 0;
+			// Steps grow large where the energy is far from quadratic or flat, limit them to overshoot less.
+			const Scalar maxStepSize = Scalar(MaxStepGrowth) * _stepSize;
+
+			switch (_stepSchedule) {
+			case BoldDriverStep:
+				return energy < prevEnergy ? std::min(stepSize * Scalar(1.1), maxStepSize) : stepSize * Scalar(0.5);
+			case BarzilaiBorweinStep: {
+				// Positions move along the positional dimensions only.
+				const typename Vector::Index posDims = _traits.getPositionDims();
+				const Scalar ss = (positions.topRows(posDims) - prevPositions.topRows(posDims)).squaredNorm();
+				const Scalar sy = (positions.topRows(posDims) - prevPositions.topRows(posDims)).cwiseProduct(
+					gradients.topRows(posDims) - prevGradients.topRows(posDims)).sum();
+				return (sy > 0 && ss > 0) ? std::min(ss / sy, maxStepSize) : stepSize;
+			}
+			default:
+				return stepSize;
+			}
+		}
+
+		/* Move all points of the locator to their new positions. */
+		static void updateLocator(Locator &loc, const Matrix &positions, std::true_type)
+		{
+			for (typename Matrix::Index i = 0; i < positions.cols(); ++i) {
+				loc.update(static_cast<size_t>(i), positions.col(i));
+			}
+		}
+
+		/* Rebuild locators that do not support in-place updates. */
+		static void updateLocator(Locator &loc, const Matrix &positions, std::false_type)
+		{
+			loc.build(positions);
+		}
+
+		/* Visits the neighbors of a sample found by the locator whose index is accepted by the filter. */
+		struct LocatorNeighbors {
+			const Locator &loc;
+			Scalar radius;
+
+			template<class Visitor, class Filter = detail::AcceptAll>
+			void operator()(size_t i, Visitor &&visitor, Filter filter = Filter()) const
+			{
+				loc.forEachWithinRadius(loc.get(i), radius, visitor, filter);
+			}
+		};
 
-			std::vector<size_t> neighborIds;
-			std::vector<Scalar> neighborDists2;
-			const Vector &query = loc.get(queryIndex);
+		/* Visits the neighbors of a sample stored in neighbor lists whose index is accepted by the filter. Distances
+		   are determined from the current positions, as samples moved since the lists were built. */
+		struct ListNeighbors {
+			const NeighborLists<Scalar> &lists;
+			const Matrix &positions;
+			Scalar radius2;
+
+			template<class Visitor, class Filter = detail::AcceptAll>
+			void operator()(size_t i, Visitor &&visitor, Filter filter = Filter()) const
+			{
+				for (size_t k = lists.offsets[i]; k < lists.offsets[i + 1]; ++k) {
+					const size_t j = lists.indices[k];
+					if (!filter(j))
+						continue;
+
+					const Scalar d2 = (positions.col(j) - positions.col(i)).squaredNorm();
+					if (d2 <= radius2 && !visitor(j, d2))
+						return;
+				}
+			}
+		};
 
-			if (!loc.findAllWithinRadius(query, _maxSearchRadius, neighborIds, neighborDists2))
-				return energy;
+		/* Buffers of symmetric pair evaluation reused across iterations. */
+		struct PairBuffers {
+			Matrix gradients;
+			std::vector<Scalar> energies;
+		};
+
+		/* Accumulate Gaussian energies and gradients of active samples visiting each pair of neighbors within a chunk
+		   of samples once, i.e from the active sample of lower index or from the active sample if the other one is
+		   inactive. Each chunk owns the columns of its samples, pairs reaching into other chunks are evaluated by
+		   both chunks for their own sample. Threads thus write disjoint columns without synchronization and results
+		   do not depend on the number of threads. Pairs are skipped before their distance is computed. Only results
+		   of active samples are updated. Kernel evaluations are counted per chunk. */
+		template<class Neighbors>
+		void pairEnergies(const Matrix &positions, const Neighbors &neighbors, const std::vector<char> &active, size_t chunkSize,
+			PairBuffers &buffers, std::vector<size_t> &evaluations) const
+		{
+			const size_t nElements = static_cast<size_t>(positions.cols());
+			const size_t nChunks = (nElements + chunkSize - 1) / chunkSize;
+
+			if (buffers.gradients.rows() != positions.rows() || static_cast<size_t>(buffers.gradients.cols()) != nElements) {
+				buffers.gradients.setZero(positions.rows(), nElements);
+				buffers.energies.assign(nElements, Scalar(0));
+			}
 
 			const Scalar sigmaSquared = _sigma * _sigma;
 			const Scalar oneOverSigmaSquared = 1 / sigmaSquared;
+			Matrix &gradient = buffers.gradients;
+			std::vector<Scalar> &energy = buffers.energies;
 
-			for (size_t nidx = 0; nidx < neighborIds.size(); ++nidx) {
-				if (neighborIds[nidx] == queryIndex)
-					continue; // don't include self
-				
-				const Vector &n = loc.get(neighborIds[nidx]);
-				const Scalar e = exp(-neighborDists2[nidx] * Scalar(0.5) * oneOverSigmaSquared);
+			detail::parallelFor(nChunks, _nThreads, [&](size_t c) {
+				const size_t begin = c * chunkSize;
+				const size_t end = std::min(nElements, begin + chunkSize);
+
+				for (size_t i = begin; i < end; ++i) {
+					if (active[i]) {
+						gradient.col(i).setZero();
+						energy[i] = 0;
+					}
+				}
+
+				for (size_t i = begin; i < end; ++i) {
+					if (!active[i])
+						continue;
 
+					evaluations[c] += forEachKernel(neighbors, i, [&](size_t id) {
+						// Visit pairs within the chunk from lower index or with inactive samples only.
+						return id > i || id < begin || (id < i && !active[id]);
+					}, [&](size_t id, Scalar e) {
+						energy[i] += e;
+						gradient.col(i) += (positions.col(id) - positions.col(i)) * (oneOverSigmaSquared * e);
+
+						if (id > i && id < end && active[id]) {
+							energy[id] += e;
+							gradient.col(id) -= (positions.col(id) - positions.col(i)) * (oneOverSigmaSquared * e);
+						}
+					});
+				}
+			});
+		}
+
+		/* Accumulate Gaussian energy and gradient of a sample while visiting its neighbors. Adds the number of kernel
+		   evaluations to evaluations. */
+		template<class Neighbors>
+		Scalar energy(size_t queryIndex, const Matrix &positions, const Neighbors &neighbors, Vector &gradient, size_t &evaluations) const
+		{
+			gradient.setZero(positions.rows());
+			Scalar energy = 0;
+
+			const Scalar sigmaSquared = _sigma * _sigma;
+			const Scalar oneOverSigmaSquared = 1 / sigmaSquared;
+
+			evaluations += forEachKernel(neighbors, queryIndex, [&](size_t id) {
+				return id != queryIndex; // don't include self
+			}, [&](size_t id, Scalar e) {
 				energy += e;
-				gradient += (n - query) * oneOverSigmaSquared * e;
-			}
+				gradient += (positions.col(id) - positions.col(queryIndex)) * (oneOverSigmaSquared * e);
+			});
 
 			return energy;
 		}
 
+		/* Visit the neighbors of a sample accepted by the filter, passing their index and Gaussian kernel value to fnc.
+		   Neighbors are collected in batches and kernel values are evaluated per batch, so that exp vectorizes. Returns
+		   the number of visited neighbors. */
+		template<class Neighbors, class Filter, class Fnc>
+		size_t forEachKernel(const Neighbors &neighbors, size_t queryIndex, Filter &&filter, Fnc &&fnc) const
+		{
+			typedef Eigen::Array<Scalar, Eigen::Dynamic, 1> Array;
+			enum { BatchSize = 64 };
+
+			Scalar args[BatchSize], values[BatchSize];
+			size_t ids[BatchSize];
+			size_t count = 0, visited = 0;
+
+			const Scalar scale = Scalar(-0.5) / (_sigma * _sigma);
+
+			auto flush = [&]() {
+				Eigen::Map<Array> v(values, count);
+				_kernelExp.evaluate(Eigen::Map<const Array>(args, count), v);
+				for (size_t k = 0; k < count; ++k) {
+					fnc(ids[k], values[k]);
+				}
+				visited += count;
+				count = 0;
+			};
+
+			neighbors(queryIndex, [&](size_t id, Scalar d2) {
+				ids[count] = id;
+				args[count] = d2 * scale;
+				if (++count == BatchSize) {
+					flush();
+				}
+				return true;
+			}, filter);
+
+			if (count > 0) {
+				flush();
+			}
+
+			return visited;
+		}
 
 		Scalar _sigma, _stepSize, _maxSearchRadius;
+		int _nThreads;
+		bool _constraintThreadSafe;
+		bool _symmetricPairs;
+		Scalar _kernelMaxRelativeError;
+		Scalar _skin;
+		Scalar _minRelativeEnergyDecrease, _minDisplacement;
+		StepSchedule _stepSchedule;
+		Scalar _activeSetThreshold;
+		size_t _iterations, _kernelEvaluations;
+		Scalar _energy;
+		StopReason _stopReason;
+		detail::ExpApproximation<Scalar> _kernelExp;
         Traits _traits;
     };
 }
@@ -0,0 +1,117 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef BBN_FAST_EXP_H
+#define BBN_FAST_EXP_H
+
+#include <Eigen/Dense>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+namespace bbn {
+	namespace detail {
+
+		/* Approximation of exp(x) for arguments in [minArgument, 0] with bounded relative error. The argument is
+		   scaled by 2^-s into [-0.5, 0], exp is evaluated there by a truncated Taylor polynomial and the result is
+		   squared s times. Only multiplications and additions are involved, so that evaluating arrays of arguments
+		   vectorizes. The degree of the polynomial is the smallest one that meets the requested maximum relative
+		   error, taking into account the amplification of the error by squaring. Rounding errors double with every
+		   squaring as well, requested errors are therefore raised to at least 2^(s+2) machine epsilons. A maximum
+		   relative error of zero selects the exact exp. */
+		template<class Scalar>
+		class ExpApproximation {
+		public:
+			enum {
+				MaxDegree = 16		/** Maximum degree of the polynomial. */
+			};
+
+			/** Exact exp. */
+			ExpApproximation()
+				:_degree(0), _squarings(0), _maxRelativeError(0)
+			{}
+
+			/** Approximation for arguments in [minArgument, 0]. */
+			ExpApproximation(Scalar minArgument, Scalar maxRelativeError)
+				:_degree(0), _squarings(0), _maxRelativeError(0)
+			{
+				if (maxRelativeError <= 0)
+					return;
+
+				while (-minArgument * std::ldexp(Scalar(1), -_squarings) > Scalar(0.5)) {
+					++_squarings;
+				}
+
+				// Half of the error is left to rounding, which stays below 2^(s+1) machine epsilons.
+				const Scalar rounding = std::ldexp(std::numeric_limits<Scalar>::epsilon(), _squarings + 1);
+				_maxRelativeError = std::max(maxRelativeError, 2 * rounding);
+
+				// The remainder of the Taylor polynomial of degree n on [-0.5, 0] is bounded by 0.5^(n+1) / (n+1)!,
+				// relative to exp(-0.5). Squaring s times multiplies the relative error by 2^s.
+				const Scalar amplification = std::ldexp(Scalar(1), _squarings) * std::exp(Scalar(0.5));
+				Scalar bound = Scalar(0.5) * amplification;
+				// Coefficients absorb the scaling of the argument by 2^-s.
+				const Scalar scale = std::ldexp(Scalar(1), -_squarings);
+				_coeffs[0] = 1;
+				for (_degree = 1; ; ++_degree) {
+					_coeffs[_degree] = _coeffs[_degree - 1] * scale / Scalar(_degree);
+					bound *= Scalar(0.5) / Scalar(_degree + 1);
+					if (bound <= _maxRelativeError - rounding || _degree == MaxDegree)
+						break;
+				}
+
+				_maxRelativeError = std::max(_maxRelativeError, bound + rounding);
+			}
+
+			/** Bound on the relative error of evaluate, zero for the exact exp. */
+			Scalar maxRelativeError() const {
+				return _maxRelativeError;
+			}
+
+			/** True if the exact exp is evaluated. */
+			bool exact() const {
+				return _degree == 0;
+			}
+
+			/** Evaluate the exponential of each argument. Arguments and results must not alias. */
+			template<class ArgumentDerived, class ResultDerived>
+			void evaluate(const Eigen::ArrayBase<ArgumentDerived> &x, Eigen::ArrayBase<ResultDerived> &result) const
+			{
+				if (exact()) {
+					result = x.exp();
+					return;
+				}
+
+				result.setConstant(_coeffs[_degree]);
+				for (int k = _degree - 1; k >= 0; --k) {
+					result = result * x + _coeffs[k];
+				}
+
+				for (int s = 0; s < _squarings; ++s) {
+					result = result.square();
+				}
+			}
+
+		private:
+			int _degree, _squarings;
+			Scalar _maxRelativeError;
+			Scalar _coeffs[MaxDegree + 1];
+		};
+
+	}
+}
+
+#endif
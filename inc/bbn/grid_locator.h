@@ -0,0 +1,401 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_GRID_LOCATOR_H
+#define BBN_GRID_LOCATOR_H
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <Eigen/Dense>
+#include <bbn/bucketing.h>
+#include <bbn/point_blocks.h>
+#include <bbn/util.h>
+
+namespace bbn {
+
+	/* Provides nearest neighbor search in n-dimensions using a flat grid of cell-sorted points and L2 metric.
+
+	   The grid is built in bulk: the cell keys of all points are computed and sorted, and each occupied cell
+	   is stored as a range (CSR offsets) into a single contiguous index array. Rebuilding therefore consists
+	   of a few linear passes and a sort without any per-point heap allocation, which makes this locator
+	   a good fit for algorithms that rebuild their search structure frequently. Coordinates are additionally
+	   stored in cell order as structure-of-arrays, so that the members of a cell are contiguous in memory and
+	   their distances are evaluated in batches.
+
+	   Points added incrementally are kept in a pending list that is searched linearly. Once the list grows
+	   beyond the square root of the number of points, the grid is rebuilt.
+
+	   Like HashtableLocator, queries visit a stencil of bucket offsets computed per search radius announced through
+	   prepare(), and fall back to the range of buckets around the query or to all points otherwise. Queries never
+	   modify the locator and may run concurrently. */
+	template<class VectorT>
+	class GridLocator {
+	public:
+
+		/** Configuration Parameters */
+		typedef BucketLocatorParams Params;
+
+		/* Construct empty locator*/
+		inline GridLocator()
+			: _resolution(typename VectorT::Scalar(0.05)), _nIndexed(0), _cellOffsets(1, 0)
+		{}
+
+		/* Construct with resolution */
+		inline GridLocator(const Params &p)
+			: _resolution(p.bucketResolution, p.bucketResolutions), _nIndexed(0), _cellOffsets(1, 0)
+		{}
+
+		/* Reset to empty state*/
+		void reset()
+		{
+			_points.clear();
+			_cellKeys.clear();
+			_cellOffsets.assign(1, 0);
+			_cellIndices.clear();
+			_nIndexed = 0;
+		}
+
+		/** Prepare queries up to the given radius. Must not be called concurrently with queries. */
+		void prepare(typename VectorT::Scalar radius)
+		{
+			_stencils.prepare(radius, dims(), _resolution);
+		}
+
+		/** Number of dimensions. */
+		typename VectorT::Index dims() const
+		{
+			if (_points.empty()) {
+				return VectorT::RowsAtCompileTime;
+			}
+			else {
+				return _points.front().rows();
+			}
+		}
+
+		/** Add a new point. */
+		void add(const VectorT &point)
+		{
+			_points.push_back(point);
+			_stencils.update(point.rows(), _resolution);
+			indexIfRequired();
+		}
+
+		/** Add a range of points. */
+		template<class VectorTIter>
+		void add(VectorTIter begin, VectorTIter end)
+		{
+			_points.insert(_points.end(), begin, end);
+			_stencils.update(dims(), _resolution);
+			indexIfRequired();
+		}
+
+		/** Replace the current content by the columns of the given matrix. */
+		template<class Derived>
+		void build(const Eigen::MatrixBase<Derived> &points)
+		{
+			_points.resize(static_cast<size_t>(points.cols()));
+			for (typename Derived::Index i = 0; i < points.cols(); ++i) {
+				_points[static_cast<size_t>(i)] = points.col(i);
+			}
+			_stencils.update(dims(), _resolution);
+			index();
+		}
+
+		/** Get the i-th stored point. */
+		const VectorT &get(size_t index) const
+		{
+			return _points[index];
+		}
+
+		/* Find any neighbor within the specified radius.*/
+		inline bool findAnyWithinRadius(const VectorT &query, typename VectorT::Scalar radius, size_t *index = 0, typename VectorT::Scalar *dist2 = 0) const {
+			typedef typename VectorT::Scalar Scalar;
+
+			Scalar bestDist2 = radius * radius;
+			size_t bestIndex = std::numeric_limits<size_t>::max();
+
+			bool found = false;
+			forEachCellRange(query, radius, bestDist2, [&](size_t first, size_t last) {
+				return visitRange(first, last, query, bestDist2, [&](size_t id, Scalar d, Scalar &) {
+					bestDist2 = d;
+					bestIndex = id;
+					found = true;
+					return false;
+				});
+			});
+
+			for (size_t i = _nIndexed; i < _points.size() && !found; ++i) {
+				const Scalar d = (query - _points[i]).squaredNorm();
+				if (d <= bestDist2) {
+					bestDist2 = d;
+					bestIndex = i;
+					found = true;
+				}
+			}
+
+			if (dist2) *dist2 = bestDist2;
+			if (index) *index = bestIndex;
+
+			return bestIndex != std::numeric_limits<size_t>::max();
+		}
+
+		/* Invoke the visitor for each neighbor within the specified radius. The visitor receives the neighbor index and
+		   its squared distance and returns false to stop the search. Neighbors whose index is rejected by the filter
+		   are skipped, mostly before their distance is computed. Returns false if the search was stopped. */
+		template<class Visitor, class Filter = detail::AcceptAll>
+		inline bool forEachWithinRadius(const VectorT &query, typename VectorT::Scalar radius, Visitor &&visitor, Filter filter = Filter()) const {
+			typedef typename VectorT::Scalar Scalar;
+
+			Scalar r2 = radius * radius;
+			const bool cont = forEachCellRange(query, radius, r2, [&](size_t first, size_t last) {
+				return visitRange(first, last, query, r2, [&](size_t id, Scalar d, Scalar &) {
+					return visitor(id, d);
+				}, filter);
+			});
+
+			if (!cont)
+				return false;
+
+			for (size_t i = _nIndexed; i < _points.size(); ++i) {
+				if (!filter(i))
+					continue;
+
+				const Scalar d = (query - _points[i]).squaredNorm();
+				if (d <= r2 && !visitor(i, d))
+					return false;
+			}
+
+			return true;
+		}
+
+		/* Find all neighbors within the specified radius.*/
+		inline bool findAllWithinRadius(const VectorT &query, typename VectorT::Scalar radius, std::vector<size_t> &indices, std::vector<typename VectorT::Scalar> &dists2) const {
+			indices.clear();
+			dists2.clear();
+
+			forEachWithinRadius(query, radius, [&](size_t id, typename VectorT::Scalar d) {
+				indices.push_back(id);
+				dists2.push_back(d);
+				return true;
+			});
+
+			return indices.size() > 0;
+		}
+
+		/* Find closest neighbor within the specified radius.*/
+		inline bool findClosestWithinRadius(const VectorT &query, typename VectorT::Scalar radius, size_t &index, typename VectorT::Scalar &dist2) const {
+			typedef typename VectorT::Scalar Scalar;
+
+			Scalar bestDist2 = radius * radius;
+			size_t bestIndex = std::numeric_limits<size_t>::max();
+
+			for (size_t i = _nIndexed; i < _points.size(); ++i) {
+				const Scalar d = (query - _points[i]).squaredNorm();
+				if (d <= bestDist2) {
+					bestDist2 = d;
+					bestIndex = i;
+				}
+			}
+
+			// Buckets are tested against the shrinking search radius.
+			forEachCellRange(query, radius, bestDist2, [&](size_t first, size_t last) {
+				return visitRange(first, last, query, bestDist2, [&](size_t id, Scalar d, Scalar &r2) {
+					r2 = d;
+					bestIndex = id;
+					return true;
+				});
+			});
+
+			dist2 = bestDist2;
+			index = bestIndex;
+
+			return bestIndex != std::numeric_limits<size_t>::max();
+		}
+
+	private:
+
+		typedef detail::Bucketing<VectorT> Bucketing;
+		typedef typename Bucketing::Bucket Bucket;
+		typedef typename Bucketing::Stencil Stencil;
+		typedef typename Bucketing::StencilCache StencilCache;
+		typedef typename Bucketing::Resolution Resolution;
+
+		/** Array of points. */
+		typedef std::vector<VectorT, Eigen::aligned_allocator<VectorT> > ArrayOfVectorT;
+
+		/** Number of points evaluated per distance batch. */
+		enum { BatchSize = 16 };
+
+		/* Invoke fnc(first, last) for the cell-sorted index ranges of all cells that may hold points within squared
+		   radius r2 of the query, where r2 is at most radius squared and may shrink in between calls. Pending points
+		   are not included. The function returns false to stop the iteration. Returns false if the iteration was
+		   stopped. */
+		template<class Fnc>
+		inline bool forEachCellRange(const VectorT &query, typename VectorT::Scalar radius, const typename VectorT::Scalar &r2, Fnc &&fnc) const
+		{
+			auto visitCell = [&](const int *b) {
+				size_t first, last;
+				return !findCell(b, query.rows(), first, last) || fnc(first, last);
+			};
+
+			const Stencil *stencil = _stencils.find(radius, query.rows());
+			if (stencil) {
+				return Bucketing::forEachBucket(*stencil, query, _resolution, r2, visitCell);
+			}
+
+			if (Bucketing::rangeSize(query, _resolution, radius) <= double(_cellOffsets.size() - 1)) {
+				return Bucketing::forEachBucketInRange(query, _resolution, radius, r2, visitCell);
+			}
+
+			return _nIndexed == 0 || fnc(size_t(0), _nIndexed);
+		}
+
+		/* Lexicographic ordering of point indices by their bucket keys. Points of a bucket are ordered by index, so
+		   that consecutive indices stay together and filtered queries skip them in batches. */
+		struct KeyLess {
+			KeyLess(const int *keys, typename VectorT::Index dims)
+				:_keys(keys), _dims(dims)
+			{}
+
+			inline bool operator()(size_t a, size_t b) const
+			{
+				const int *ka = _keys + a * _dims;
+				const int *kb = _keys + b * _dims;
+				const std::pair<const int *, const int *> m = std::mismatch(ka, ka + _dims, kb);
+				return m.first != ka + _dims ? *m.first < *m.second : a < b;
+			}
+
+			const int *_keys;
+			typename VectorT::Index _dims;
+		};
+
+		/* Rebuild grid from scratch when the pending list has grown too large. */
+		void indexIfRequired()
+		{
+			const size_t nPending = _points.size() - _nIndexed;
+			if (nPending >= 64 && nPending * nPending > _points.size()) {
+				index();
+			}
+		}
+
+		/* Sort all points by bucket and compute cell offsets. */
+		void index()
+		{
+			const size_t n = _points.size();
+			_cellKeys.clear();
+			_cellOffsets.assign(1, 0);
+			_cellIndices.resize(n);
+			_nIndexed = n;
+
+			if (n == 0)
+				return;
+
+			const typename VectorT::Index d = dims();
+			_pointKeys.resize(n * d);
+			for (size_t i = 0; i < n; ++i) {
+				Bucketing::toBucket(_points[i], _resolution, &_pointKeys[i * d]);
+				_cellIndices[i] = i;
+			}
+
+			std::sort(_cellIndices.begin(), _cellIndices.end(), KeyLess(&_pointKeys[0], d));
+
+			const int *prev = 0;
+			for (size_t i = 0; i < n; ++i) {
+				const int *key = &_pointKeys[_cellIndices[i] * d];
+				if (prev == 0 || !std::equal(key, key + d, prev)) {
+					if (prev != 0) {
+						_cellOffsets.push_back(i);
+					}
+					_cellKeys.insert(_cellKeys.end(), key, key + d);
+					prev = key;
+				}
+			}
+			_cellOffsets.push_back(n);
+
+			_sortedCoords.resize(n * d);
+			for (typename VectorT::Index i = 0; i < d; ++i) {
+				for (size_t j = 0; j < n; ++j) {
+					_sortedCoords[i * n + j] = _points[_cellIndices[j]](i);
+				}
+			}
+		}
+
+		/* Visit all points of the cell-sorted range [first, last) whose squared distance to query is at most r2 and
+		   whose index is accepted by the filter. The function receives the point index, its squared distance and a
+		   reference to r2 it may shrink. Returns false to stop. Batches without accepted points are skipped before
+		   computing their distances. */
+		template<class Fnc, class Filter = detail::AcceptAll>
+		inline bool visitRange(size_t first, size_t last, const VectorT &query, typename VectorT::Scalar &r2, Fnc &&fnc, Filter filter = Filter()) const
+		{
+			EIGEN_ALIGN16 typename VectorT::Scalar dists2[BatchSize];
+
+			for (size_t b = first; b < last; b += BatchSize) {
+				const size_t count = std::min<size_t>(BatchSize, last - b);
+
+				size_t accepted = 0;
+				while (accepted < count && !filter(_cellIndices[b + accepted])) {
+					++accepted;
+				}
+				if (accepted == count)
+					continue;
+
+				detail::squaredDistances<Eigen::Dynamic>(query, &_sortedCoords[b], _nIndexed, count, dists2);
+
+				for (size_t i = accepted; i < count; ++i) {
+					if (dists2[i] <= r2 && filter(_cellIndices[b + i]) && !fnc(_cellIndices[b + i], dists2[i], r2))
+						return false;
+				}
+			}
+
+			return true;
+		}
+
+		/* Locate the index range of the bucket with the given coordinates. Returns false if the bucket is empty. */
+		inline bool findCell(const int *key, typename VectorT::Index d, size_t &first, size_t &last) const
+		{
+			size_t lo = 0, hi = _cellOffsets.size() - 1;
+			while (lo < hi) {
+				const size_t mid = lo + (hi - lo) / 2;
+				const int *cell = &_cellKeys[mid * d];
+				if (std::lexicographical_compare(cell, cell + d, key, key + d)) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+
+			if (lo == _cellOffsets.size() - 1 || !std::equal(key, key + d, &_cellKeys[lo * d]))
+				return false;
+
+			first = _cellOffsets[lo];
+			last = _cellOffsets[lo + 1];
+			return true;
+		}
+
+		ArrayOfVectorT _points;
+		Resolution _resolution;
+		size_t _nIndexed;
+		std::vector<int> _cellKeys;
+		std::vector<size_t> _cellOffsets;
+		std::vector<size_t> _cellIndices;
+		std::vector<int> _pointKeys;
+		std::vector<typename VectorT::Scalar, Eigen::aligned_allocator<typename VectorT::Scalar> > _sortedCoords;
+		StencilCache _stencils;
+	};
+
+}
+
+#endif
@@ -17,43 +17,57 @@
 #define BBN_HASHTABLE_LOCATOR_H
 
 #include <vector>
-#include <unordered_map>
 #include <limits>
 #include <Eigen/Dense>
 #include <bbn/eigen_types.h>
+#include <bbn/bucketing.h>
+#include <bbn/cell_table.h>
+#include <bbn/point_blocks.h>
+#include <bbn/util.h>
 
 namespace bbn {
 
-	/* Provides nearest neighbor search in n-dimensions using bucket hashing and L2 metric. */
+	/* Provides nearest neighbor search in n-dimensions using bucket hashing and L2 metric. The members of each bucket
+	   are stored contiguously in structure-of-arrays blocks, so that distances are evaluated for a whole block at once.
+
+	   Buckets are identified by their coordinates packed into a 64-bit code and hashed into an open-addressing table
+	   that maps codes to the block chains of a shared pool. Once a point is added whose bucket coordinates do not fit
+	   into the packed code, all buckets are re-keyed by a hash of their full coordinates instead.
+
+	   Queries visit the buckets of a stencil of relative offsets that is computed once per search radius announced
+	   through prepare(). Queries with radii not covered by a prepared stencil, or whose stencil would be too large,
+	   iterate the range of buckets around the query instead, or test all points when there are fewer occupied buckets
+	   than the range holds. Queries never modify the locator and may run concurrently. */
 	template<class VectorT>
 	class HashtableLocator {
 	public:
 
 		/** Configuration Parameters */
-		struct Params {
-			float bucketResolution;
-
-			/** Defaults */
-			Params()
-				:bucketResolution(typename VectorT::Scalar(0.05))
-			{}
-		};
+		typedef BucketLocatorParams Params;
 
 		/* Construct empty locator*/
 		inline HashtableLocator()
-			: _bucketSize(0.05f), _invBucketResolution(1.f / 0.05f)
+			: _resolution(typename VectorT::Scalar(0.05)), _hashedCodes(false)
 		{}
 
 		/* Construct with resolution */
 		inline HashtableLocator(const Params &p)
-			: _bucketSize(p.bucketResolution), _invBucketResolution(1.f / p.bucketResolution)
+			: _resolution(p.bucketResolution, p.bucketResolutions), _hashedCodes(false)
 		{}
 
 		/* Reset to empty state*/
 		void reset()
 		{
 			_points.clear();
-			_bucketHash.clear();
+			_bucketTable.clear();
+			_blocks.reset();
+			_hashedCodes = false;
+		}
+
+		/** Prepare queries up to the given radius. Must not be called concurrently with queries. */
+		void prepare(typename VectorT::Scalar radius)
+		{
+			_stencils.prepare(radius, dims(), _resolution);
 		}
 
 
@@ -71,11 +85,32 @@ namespace bbn {
 		/** Add a new point. */
 		void add(const VectorT &point)
 		{
+			const Code c = codeOf(point);
+
 			size_t index = _points.size();
 			_points.push_back(point);
-			
-			Bucket b = toBucket(point, _invBucketResolution);
-			_bucketHash[b].push_back(index);
+			_stencils.update(point.rows(), _resolution);
+
+			insertIntoBucket(c, index, point);
+		}
+
+		/** Move the i-th stored point to a new position. The point is only rehashed when its bucket changes. */
+		void update(size_t index, const VectorT &point)
+		{
+			const Code next = codeOf(point);
+			const Code prev = codeOf(_points[index]);
+			_points[index] = point;
+
+			if (prev == next) {
+				_blocks.set(index, point);
+				return;
+			}
+
+			// Emptied buckets are kept, so that points moving back and forth do not cause rehashing.
+			size_t &prevHead = _bucketTable.findOrInsert(prev, detail::PointBlockPool<VectorT>::InvalidBlock);
+			prevHead = _blocks.remove(prevHead, index);
+
+			insertIntoBucket(next, index, point);
 		}
 
 		/** Add a range of points. */
@@ -87,6 +122,17 @@ namespace bbn {
 			}
 		}
 
+		/** Replace the current content by the columns of the given matrix. */
+		template<class Derived>
+		void build(const Eigen::MatrixBase<Derived> &points)
+		{
+			reset();
+			_points.reserve(static_cast<size_t>(points.cols()));
+			for (typename Derived::Index i = 0; i < points.cols(); ++i) {
+				add(points.col(i));
+			}
+		}
+
 		/** Get the i-th stored point. */
 		const VectorT &get(size_t index) const
 		{
@@ -95,35 +141,16 @@ namespace bbn {
 
 		/* Find any neighbor within the specified radius.*/
 		inline bool findAnyWithinRadius(const VectorT &query, typename VectorT::Scalar radius, size_t *index = 0, typename VectorT::Scalar *dist2 = 0) const {			
-			typename VectorT::Scalar bestDist2 = radius * radius;
-			size_t bestIndex = std::numeric_limits<size_t>::max();
-
-			Bucket minCorner, maxCorner;
-			ballToBuckets(query, radius, _invBucketResolution, minCorner, maxCorner);
-
-			BucketRangeIterator begin = BucketRangeIterator(minCorner, maxCorner);
-			BucketRangeIterator end;
-
-			bool found = false;
-			for (BucketRangeIterator biter = begin; biter != end && !found; ++biter) {
-
-				if (!testBallOverlapsBucket(query, radius, *biter, _bucketSize))
-					continue;
+			typedef typename VectorT::Scalar Scalar;
 
-				typename BucketHash::const_iterator iter = _bucketHash.find(*biter);
-				if (iter != _bucketHash.end()) {
-					for (size_t i = 0; i < iter->second.size(); ++i) {
-						const float d = (query - _points[iter->second[i]]).squaredNorm();
-						if (d <= bestDist2) {
-							bestDist2 = d;
-							bestIndex = iter->second[i];
-							found = true;
-							break;
-						}
-					}
-				}
-			}
+			Scalar bestDist2 = radius * radius;
+			size_t bestIndex = std::numeric_limits<size_t>::max();
 
+			forEachCandidate(query, radius, bestDist2, [&](size_t id, Scalar d, Scalar &) {
+				bestDist2 = d;
+				bestIndex = id;
+				return false;
+			});
 
 			if (dist2) *dist2 = bestDist2;
 			if (index) *index = bestIndex;
@@ -131,69 +158,46 @@ namespace bbn {
 			return bestIndex != std::numeric_limits<size_t>::max();
 		}
 
+		/* Invoke the visitor for each neighbor within the specified radius. The visitor receives the neighbor index and
+		   its squared distance and returns false to stop the search. Neighbors whose index is rejected by the filter
+		   are skipped, mostly before their distance is computed. Returns false if the search was stopped. */
+		template<class Visitor, class Filter = detail::AcceptAll>
+		inline bool forEachWithinRadius(const VectorT &query, typename VectorT::Scalar radius, Visitor &&visitor, Filter filter = Filter()) const {
+			typedef typename VectorT::Scalar Scalar;
+
+			Scalar r2 = radius * radius;
+			return forEachCandidate(query, radius, r2, [&](size_t id, Scalar d, Scalar &) {
+				return visitor(id, d);
+			}, filter);
+		}
+
 		/* Find all neighbors within the specified radius.*/
 		inline bool findAllWithinRadius(const VectorT &query, typename VectorT::Scalar radius, std::vector<size_t> &indices, std::vector<typename VectorT::Scalar> &dists2) const {
-			const typename VectorT::Scalar r2 = radius * radius;
-
 			indices.clear();
 			dists2.clear();
 
-			Bucket minCorner, maxCorner;
-			ballToBuckets(query, radius, _invBucketResolution, minCorner, maxCorner);
-
-			BucketRangeIterator begin = BucketRangeIterator(minCorner, maxCorner);
-			BucketRangeIterator end;
-
-			for (BucketRangeIterator biter = begin; biter != end; ++biter) {
-
-				if (!testBallOverlapsBucket(query, radius, *biter, _bucketSize))
-					continue;
-
-				typename BucketHash::const_iterator iter = _bucketHash.find(*biter);
-				if (iter != _bucketHash.end()) {
-					for (size_t i = 0; i < iter->second.size(); ++i) {
-						const float d = (query - _points[iter->second[i]]).squaredNorm();
-						if (d <= r2) {
-							indices.push_back(iter->second[i]);
-							dists2.push_back(d);
-						}
-					}
-				}
-			}
+			forEachWithinRadius(query, radius, [&](size_t id, typename VectorT::Scalar d) {
+				indices.push_back(id);
+				dists2.push_back(d);
+				return true;
+			});
 
 			return indices.size() > 0;
 		}
 
 		/* Find closest neighbor within the specified radius.*/
 		inline bool findClosestWithinRadius(const VectorT &query, typename VectorT::Scalar radius, size_t &index, typename VectorT::Scalar &dist2) const {
+			typedef typename VectorT::Scalar Scalar;
 
-			typename VectorT::Scalar bestDist2 = radius * radius;
+			Scalar bestDist2 = radius * radius;
 			size_t bestIndex = std::numeric_limits<size_t>::max();
 
-			Bucket minCorner, maxCorner;
-			ballToBuckets(query, radius, _invBucketResolution, minCorner, maxCorner);
-
-			BucketRangeIterator begin = BucketRangeIterator(minCorner, maxCorner);
-			BucketRangeIterator end;
-
-			for (BucketRangeIterator biter = begin; biter != end; ++biter) {
-
-				if (!testBallOverlapsBucket(query, radius, *biter, _bucketSize))
-					continue;
-
-				typename BucketHash::const_iterator iter = _bucketHash.find(*biter);
-				if (iter != _bucketHash.end()) {
-					for (size_t i = 0; i < iter->second.size(); ++i) {
-						const float d = (query - _points[iter->second[i]]).squaredNorm();
-						if (d <= bestDist2) {
-							bestDist2 = d;
-							bestIndex = iter->second[i];
-							radius = std::sqrt(bestDist2);
-						}
-					}
-				}
-			}
-
+			// Buckets are tested against the shrinking search radius.
+			forEachCandidate(query, radius, bestDist2, [&](size_t id, Scalar d, Scalar &r2) {
+				r2 = d;
+				bestIndex = id;
+				return true;
+			});
 
 			dist2 = bestDist2;
 			index = bestIndex;
@@ -203,165 +207,95 @@ namespace bbn {
 
 	private:	
 
-		/* An bucket in n-dimensions. */
-		typedef typename Eigen::Matrix<int, VectorT::RowsAtCompileTime, 1> Bucket;
-
-		/* Provides hashing  and bucket comparison of bucket objects. */
-		struct BucketHasher {
-
-			/* Hash bucket*/
-			inline std::size_t operator()(const Bucket& k) const
-			{	
-				std::size_t seed = 0;
+		typedef detail::Bucketing<VectorT> Bucketing;
+		typedef typename Bucketing::Bucket Bucket;
+		typedef typename Bucketing::Code Code;
+		typedef typename Bucketing::Stencil Stencil;
+		typedef typename Bucketing::StencilCache StencilCache;
+		typedef typename Bucketing::Resolution Resolution;
 
-				// Mimics boost::hash_combine for arbitrary sized vectors.
-				for (int i = 0; i < k.rows(); ++i) {
-					seed ^= static_cast<size_t>(scalarHasher(k(i))) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-				}
-
-				return seed;
-			}
-
-			/* Compare two buckets for equality. */
-			inline bool operator()(const Bucket &k0, const Bucket &k1) const
-			{
-				for (typename Bucket::Index i = 0; i < k0.rows(); ++i) {
-					if (k0(i) != k1(i))
-						return false;
-				}
-				return true;
-			}
-
-			std::hash<typename Bucket::Scalar> scalarHasher;
-		};
-
-		/* Provides n-dimensional iteration over bucket indices. */
-		class BucketRangeIterator {
-		public:
-			/* Construct iterator from range to iterate. Both corners are inclusive. */
-			BucketRangeIterator(const Bucket &minCorner, const Bucket &maxCorner)
-				:_n(minCorner.rows()), _current(minCorner), _minCorner(minCorner), _maxCorner(maxCorner)
-			{
-				if (((_maxCorner - _minCorner).array() < 0).any()) {
-					_n = 0;
-				}
-			}
-
-			/* Construct invalid or end iterator. */
-			BucketRangeIterator()
-				:_n(0)
-			{}
-
-			const Bucket &operator*() const 
-			{
-				return _current;
-			}
+		/** Array of points. */
+		typedef std::vector<VectorT, Eigen::aligned_allocator<VectorT> > ArrayOfVectorT;
 
-			/* Increment iterator to next position. */
-			BucketRangeIterator &operator++() 
-			{
-				// Pop elements that correspond to maximum corner.
-				while (_n > 0 && _current(_n - 1) >= _maxCorner(_n - 1)) {
-					--_n;
-				}
-
-				// Increment position and fill up remainder
-				if (_n > 0) {
-					_current(_n - 1) += 1;
-
-					if (_n < _minCorner.rows()) {
-						const typename Bucket::Index nRowsToFill = _current.rows() - _n;
-						_current.tail(nRowsToFill) = _minCorner.tail(nRowsToFill);
-						_n = _minCorner.rows();
-					}
-				}
-
-				return *this;
-			}
 
-			/* Test for equality. */
-			bool operator==(const BucketRangeIterator &other) const
-			{
-				if (_n == 0 || other._n == 0) {
-					return _n == 0 && other._n == 0;
-				}
-				else {
-					return _current == other._current;
-				}
+		/* Visit all points within squared radius r2 of the query whose index is accepted by the filter, where r2 is at
+		   most radius squared. The function receives the point index, its squared distance and a reference to r2 it
+		   may shrink. Returns false to stop. Buckets are visited through a prepared stencil or the bucket range around
+		   the query. When the range holds more buckets than are occupied, all points are tested instead. */
+		template<class Fnc, class Filter = detail::AcceptAll>
+		inline bool forEachCandidate(const VectorT &query, typename VectorT::Scalar radius, typename VectorT::Scalar &r2, Fnc &&fnc, Filter filter = Filter()) const
+		{
+			auto visitBucket = [&](const int *b) {
+				const size_t *head = _bucketTable.find(bucketCode(b, query.rows()));
+				return !head || _blocks.visit(*head, query, r2, fnc, filter);
+			};
+
+			const Stencil *stencil = _stencils.find(radius, query.rows());
+			if (stencil && _hashedCodes) {
+				return Bucketing::forEachBucket(*stencil, query, _resolution, r2, visitBucket);
+			} else if (stencil) {
+				return Bucketing::forEachCode(*stencil, query, _resolution, r2, [&](Code c) {
+					const size_t *head = _bucketTable.find(c);
+					return !head || _blocks.visit(*head, query, r2, fnc, filter);
+				});
 			}
 
-			/* Test for inequality. */
-			bool operator!=(const BucketRangeIterator &other) const
-			{
-				return !operator==(other);
+			if (Bucketing::rangeSize(query, _resolution, radius) <= double(_bucketTable.size())) {
+				return Bucketing::forEachBucketInRange(query, _resolution, radius, r2, visitBucket);
 			}
 
-		private:
-			typename Bucket::Index _n;
-			Bucket _current, _minCorner, _maxCorner;
-		};
-		
-		/** Hash from bucket to list of points in bucket. */
-		typedef std::unordered_map<Bucket, std::vector<size_t>, BucketHasher, BucketHasher> BucketHash;
-		/** Array of points. */
-		typedef std::vector<VectorT, Eigen::aligned_allocator<VectorT> > ArrayOfVectorT;
-
+			for (size_t i = 0; i < _points.size(); ++i) {
+				if (!filter(i))
+					continue;
 
-		/* Converts a point to a bucket. */
-		static inline Bucket toBucket(const VectorT &point, typename VectorT::Scalar invResolution) 
-		{ 
-			Bucket b(point.rows(), 1);
-			for (typename VectorT::Index i = 0; i < point.rows(); ++i) {
-				b(i) = static_cast<int>(std::floor(point(i) * invResolution));
+				const typename VectorT::Scalar d = (query - _points[i]).squaredNorm();
+				if (d <= r2 && !fnc(i, d, r2))
+					return false;
 			}
-			return b;
-			
+			return true;
 		}
 
-		/* Converts a bucket back to a world point. The worldpoint describes the buckets min-corner*/
-		static inline VectorT toWorldPoint(const Bucket &b, typename VectorT::Scalar resolution) {
-			return b.template cast<typename VectorT::Scalar>() * resolution;
+		/* Code of the bucket with the given coordinates. */
+		inline Code bucketCode(const int *b, typename VectorT::Index dims) const
+		{
+			return _hashedCodes ? Bucketing::hashCode(b, dims) : Bucketing::toCode(b, dims);
 		}
 
-		/** Converts a n-dimensional ball search to a list of buckets to search. Note that declaring the range of buckets as AABB is not ideal
-			leads to possibly more buckets to search, especially in higher dimensions. */
-		static inline void ballToBuckets(const VectorT &point, typename VectorT::Scalar radius, typename VectorT::Scalar invResolution, Bucket &minCorner, Bucket &maxCorner)
+		/* Code of the bucket of the given point. Switches to hashed codes if the bucket does not fit into a packed code. */
+		Code codeOf(const VectorT &point)
 		{
-			minCorner = toBucket(point - VectorT::Constant(radius), invResolution);
-			maxCorner = toBucket(point + VectorT::Constant(radius), invResolution);
+			typename Bucketing::BucketScratch b(point.rows());
+			Bucketing::toBucket(point, _resolution, b.data());
+			if (!_hashedCodes && !Bucketing::fitsCode(b.data(), point.rows())) {
+				rehash();
+			}
+			return bucketCode(b.data(), point.rows());
 		}
 
-		/* Test for intersection between an n-dimensional sphere and bounds.
-		   Based on "On faster sphere box overlap testing" 
-		   http://www.mrtc.mdh.se/projects/3Dgraphics/paperF.pdf
-		 */
-		static inline bool testBallOverlapsBucket(const VectorT &center, typename VectorT::Scalar radius, const Bucket &minCorner, typename VectorT::Scalar cellSize)
+		/* Re-key the buckets of all stored points by hashed codes. */
+		void rehash()
 		{
-			typedef typename VectorT::Scalar Scalar;
-
-			VectorT worldMinCorner = toWorldPoint(minCorner,  cellSize);
-
-            Scalar d = 0;
-			for (typename Bucket::Index i = 0; i < minCorner.rows(); ++i) {
-				// On the first glance this seems like it misses a case, when the center is inside the bounds in the current dimension.
-				// But that's not the case, as in this scenerio the closest value is the center value itself, leading to zero error term.
-				Scalar e = std::max<Scalar>(worldMinCorner(i) - center(i), 0) + 
-						   std::max<Scalar>(center(i) - (worldMinCorner(i) + cellSize), 0);
-
-				// In the paper it seems like there is a typo at this point.
-				if (e > radius)
-					return false;
-				d += e*e;
+			_hashedCodes = true;
+			_bucketTable.clear();
+			_blocks.reset();
+			for (size_t i = 0; i < _points.size(); ++i) {
+				insertIntoBucket(codeOf(_points[i]), i, _points[i]);
 			}
+		}
 
-			return d <= radius * radius;
-			return true;
+		/* Add point to the block chain of the given bucket. */
+		void insertIntoBucket(Code c, size_t index, const VectorT &point)
+		{
+			size_t &head = _bucketTable.findOrInsert(c, detail::PointBlockPool<VectorT>::InvalidBlock);
+			head = _blocks.insert(head, index, point);
 		}
 
-		
-		BucketHash _bucketHash;
+		detail::CellTable _bucketTable;
+		detail::PointBlockPool<VectorT> _blocks;
 		ArrayOfVectorT _points;
-		typename VectorT::Scalar _bucketSize, _invBucketResolution;
+		Resolution _resolution;
+		StencilCache _stencils;
+		bool _hashedCodes;
 	};
 
 }
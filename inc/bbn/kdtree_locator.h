@@ -0,0 +1,429 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_KDTREE_LOCATOR_H
+#define BBN_KDTREE_LOCATOR_H
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <Eigen/Dense>
+#include <bbn/scratch.h>
+#include <bbn/util.h>
+
+namespace bbn {
+
+	/* Provides nearest neighbor search in n-dimensions using a bucketed kd-tree and L2 metric.
+
+	   In contrast to the grid based locators, the number of nodes visited by a radius query does not grow
+	   exponentially with the number of dimensions, which makes this locator the preferred choice for
+	   stacked vectors with many feature dimensions.
+
+	   The tree supports incremental insertion: points are appended to the leaf containing them and leaves
+	   are split at the median of their widest dimension once they exceed the configured leaf size. */
+	template<class VectorT>
+	class KdTreeLocator {
+	public:
+
+		/** Configuration Parameters */
+		struct Params {
+			size_t leafSize;
+
+			/** Defaults */
+			Params()
+				:leafSize(16)
+			{}
+		};
+
+		/* Construct empty locator*/
+		inline KdTreeLocator()
+			: _leafSize(16)
+		{}
+
+		/* Construct with leaf size */
+		inline KdTreeLocator(const Params &p)
+			: _leafSize(std::max<size_t>(p.leafSize, 1))
+		{}
+
+		/* Reset to empty state*/
+		void reset()
+		{
+			_points.clear();
+			_leafOf.clear();
+			_nodes.clear();
+		}
+
+		/** Has no effect, the tree keeps no per-radius state. */
+		void prepare(typename VectorT::Scalar)
+		{}
+
+		/** Number of dimensions. */
+		typename VectorT::Index dims() const
+		{
+			if (_points.empty()) {
+				return VectorT::RowsAtCompileTime;
+			}
+			else {
+				return _points.front().rows();
+			}
+		}
+
+		/** Add a new point. */
+		void add(const VectorT &point)
+		{
+			size_t index = _points.size();
+			_points.push_back(point);
+			_leafOf.push_back(0);
+
+			if (_nodes.empty()) {
+				_nodes.push_back(Node());
+			}
+
+			insert(findLeaf(point), index);
+		}
+
+		/** Add a range of points. */
+		template<class VectorTIter>
+		void add(VectorTIter begin, VectorTIter end)
+		{
+			for (VectorTIter i = begin; i != end; ++i) {
+				add(*i);
+			}
+		}
+
+		/** Replace the current content by the columns of the given matrix. Builds a balanced tree. */
+		template<class Derived>
+		void build(const Eigen::MatrixBase<Derived> &points)
+		{
+			const size_t n = static_cast<size_t>(points.cols());
+
+			_nodes.clear();
+			_points.resize(n);
+			_leafOf.resize(n);
+			_scratch.resize(n);
+			for (size_t i = 0; i < n; ++i) {
+				_points[i] = points.col(i);
+				_scratch[i] = i;
+			}
+
+			if (n > 0) {
+				buildNode(&_scratch[0], &_scratch[0] + n);
+			}
+		}
+
+		/** Move the i-th stored point to a new position. The point is only relocated when its leaf changes. */
+		void update(size_t index, const VectorT &point)
+		{
+			_points[index] = point;
+
+			const size_t leaf = findLeaf(point);
+			if (leaf == _leafOf[index]) {
+				// Moving within a leaf of duplicates may make it splittable again.
+				_nodes[leaf].unsplittable = false;
+				return;
+			}
+
+			std::vector<size_t> &ids = _nodes[_leafOf[index]].ids;
+			std::vector<size_t>::iterator iter = std::find(ids.begin(), ids.end(), index);
+			*iter = ids.back();
+			ids.pop_back();
+
+			insert(leaf, index);
+		}
+
+		/** Get the i-th stored point. */
+		const VectorT &get(size_t index) const
+		{
+			return _points[index];
+		}
+
+		/* Find any neighbor within the specified radius.*/
+		inline bool findAnyWithinRadius(const VectorT &query, typename VectorT::Scalar radius, size_t *index = 0, typename VectorT::Scalar *dist2 = 0) const {
+			typedef typename VectorT::Scalar Scalar;
+
+			Scalar bestDist2 = radius * radius;
+			size_t bestIndex = std::numeric_limits<size_t>::max();
+
+			if (!_nodes.empty()) {
+				OffsetScratch offsets(query.rows(), Scalar(0));
+				searchNode(0, query, Scalar(0), offsets.data(), bestDist2, [&](size_t id, Scalar d, Scalar &) {
+					bestDist2 = d;
+					bestIndex = id;
+					return false;
+				});
+			}
+
+			if (dist2) *dist2 = bestDist2;
+			if (index) *index = bestIndex;
+
+			return bestIndex != std::numeric_limits<size_t>::max();
+		}
+
+		/* Invoke the visitor for each neighbor within the specified radius. The visitor receives the neighbor index and
+		   its squared distance and returns false to stop the search. Neighbors whose index is rejected by the filter
+		   are skipped before their distance is computed. Returns false if the search was stopped. */
+		template<class Visitor, class Filter = detail::AcceptAll>
+		inline bool forEachWithinRadius(const VectorT &query, typename VectorT::Scalar radius, Visitor &&visitor, Filter filter = Filter()) const {
+			typedef typename VectorT::Scalar Scalar;
+
+			Scalar r2 = radius * radius;
+			if (_nodes.empty())
+				return true;
+
+			OffsetScratch offsets(query.rows(), Scalar(0));
+			return searchNode(0, query, Scalar(0), offsets.data(), r2, [&](size_t id, Scalar d, Scalar &) {
+				return visitor(id, d);
+			}, filter);
+		}
+
+		/* Find all neighbors within the specified radius.*/
+		inline bool findAllWithinRadius(const VectorT &query, typename VectorT::Scalar radius, std::vector<size_t> &indices, std::vector<typename VectorT::Scalar> &dists2) const {
+			indices.clear();
+			dists2.clear();
+
+			forEachWithinRadius(query, radius, [&](size_t id, typename VectorT::Scalar d) {
+				indices.push_back(id);
+				dists2.push_back(d);
+				return true;
+			});
+
+			return indices.size() > 0;
+		}
+
+		/* Find closest neighbor within the specified radius.*/
+		inline bool findClosestWithinRadius(const VectorT &query, typename VectorT::Scalar radius, size_t &index, typename VectorT::Scalar &dist2) const {
+			typedef typename VectorT::Scalar Scalar;
+
+			Scalar bestDist2 = radius * radius;
+			size_t bestIndex = std::numeric_limits<size_t>::max();
+
+			if (!_nodes.empty()) {
+				OffsetScratch offsets(query.rows(), Scalar(0));
+				searchNode(0, query, Scalar(0), offsets.data(), bestDist2, [&](size_t id, Scalar d, Scalar &r2) {
+					r2 = d;
+					bestIndex = id;
+					return true;
+				});
+			}
+
+			dist2 = bestDist2;
+			index = bestIndex;
+
+			return bestIndex != std::numeric_limits<size_t>::max();
+		}
+
+	private:
+
+		/** Array of points. */
+		typedef std::vector<VectorT, Eigen::aligned_allocator<VectorT> > ArrayOfVectorT;
+
+		/** Per-query distances to the cutting planes, kept on the stack for up to 32 dynamic dimensions. */
+		typedef detail::ScratchArray<typename VectorT::Scalar,
+			(VectorT::RowsAtCompileTime != Eigen::Dynamic) ? int(VectorT::RowsAtCompileTime) : 32> OffsetScratch;
+
+		/* A node of the tree. Inner nodes split space along a single dimension, leaves hold point indices. */
+		struct Node {
+			Node()
+				:dim(-1), split(0), unsplittable(false)
+			{
+				children[0] = children[1] = 0;
+			}
+
+			int dim;
+			typename VectorT::Scalar split;
+			size_t children[2];
+			std::vector<size_t> ids;
+			/** Set for oversized leaves that failed to split, i.e. hold only duplicates. */
+			bool unsplittable;
+		};
+
+		/* Find the leaf whose region contains the given point. */
+		inline size_t findLeaf(const VectorT &point) const
+		{
+			size_t node = 0;
+			while (_nodes[node].dim >= 0) {
+				const Node &n = _nodes[node];
+				node = n.children[point(n.dim) < n.split ? 0 : 1];
+			}
+			return node;
+		}
+
+		/* Append point to leaf and split the leaf when it becomes too large. Leaves of duplicates are only reconsidered
+		   once a point of different position arrives, so that inserting many duplicates does not rescan the leaf. */
+		void insert(size_t leaf, size_t index)
+		{
+			Node &l = _nodes[leaf];
+			if (l.unsplittable && !l.ids.empty() && _points[l.ids.front()] != _points[index]) {
+				l.unsplittable = false;
+			}
+
+			l.ids.push_back(index);
+			_leafOf[index] = leaf;
+
+			if (l.ids.size() <= _leafSize || l.unsplittable)
+				return;
+
+			_scratch = l.ids;
+
+			int dim;
+			typename VectorT::Scalar split;
+			size_t *mid;
+			if (!chooseSplit(&_scratch[0], &_scratch[0] + _scratch.size(), dim, split, mid)) {
+				l.unsplittable = true;
+				return;
+			}
+
+			size_t children[2] = { _nodes.size(), _nodes.size() + 1 };
+			_nodes.resize(_nodes.size() + 2);
+			makeLeaf(children[0], &_scratch[0], mid);
+			makeLeaf(children[1], mid, &_scratch[0] + _scratch.size());
+
+			Node &n = _nodes[leaf];
+			std::vector<size_t>().swap(n.ids);
+			n.dim = dim;
+			n.split = split;
+			n.children[0] = children[0];
+			n.children[1] = children[1];
+		}
+
+		/* Recursively build a balanced subtree for the given range of point indices. */
+		size_t buildNode(size_t *begin, size_t *end)
+		{
+			const size_t node = _nodes.size();
+			_nodes.push_back(Node());
+
+			int dim;
+			typename VectorT::Scalar split;
+			size_t *mid;
+			if (static_cast<size_t>(end - begin) <= _leafSize) {
+				makeLeaf(node, begin, end);
+				return node;
+			}
+
+			if (!chooseSplit(begin, end, dim, split, mid)) {
+				makeLeaf(node, begin, end);
+				_nodes[node].unsplittable = true;
+				return node;
+			}
+
+			const size_t left = buildNode(begin, mid);
+			const size_t right = buildNode(mid, end);
+
+			Node &n = _nodes[node];
+			n.dim = dim;
+			n.split = split;
+			n.children[0] = left;
+			n.children[1] = right;
+
+			return node;
+		}
+
+		/* Turn node into a leaf holding the given point indices. */
+		void makeLeaf(size_t node, const size_t *begin, const size_t *end)
+		{
+			_nodes[node].ids.assign(begin, end);
+			for (const size_t *i = begin; i != end; ++i) {
+				_leafOf[*i] = node;
+			}
+		}
+
+		/* Determine splitting plane at the median of the widest dimension and partition indices accordingly.
+		   Returns false when the points cannot be separated. */
+		bool chooseSplit(size_t *begin, size_t *end, int &dim, typename VectorT::Scalar &split, size_t *&mid) const
+		{
+			typedef typename VectorT::Scalar Scalar;
+
+			VectorT minCorner = _points[*begin];
+			VectorT maxCorner = _points[*begin];
+			for (size_t *i = begin + 1; i != end; ++i) {
+				minCorner = minCorner.cwiseMin(_points[*i]);
+				maxCorner = maxCorner.cwiseMax(_points[*i]);
+			}
+
+			typename VectorT::Index widest;
+			const Scalar spread = (maxCorner - minCorner).maxCoeff(&widest);
+			if (spread <= Scalar(0))
+				return false;
+
+			dim = static_cast<int>(widest);
+
+			const ArrayOfVectorT &points = _points;
+			size_t *median = begin + (end - begin) / 2;
+			std::nth_element(begin, median, end, [&](size_t a, size_t b) { return points[a](widest) < points[b](widest); });
+			split = points[*median](widest);
+
+			mid = std::partition(begin, end, [&](size_t a) { return points[a](widest) < split; });
+			if (mid == begin) {
+				// Duplicates of the minimum value. Fall back to the center of the range.
+				split = Scalar(0.5) * (minCorner(widest) + maxCorner(widest));
+				mid = std::partition(begin, end, [&](size_t a) { return points[a](widest) < split; });
+			}
+
+			return mid != begin && mid != end;
+		}
+
+		/* Traverse the tree and report points within the radius whose index is accepted by the filter to the given function.
+		   Descends into the nearer child first and prunes subtrees using the incremental distance to their region (Arya and
+		   Mount). The function may shrink the search radius and returns false to stop the search. */
+		template<class LeafFnc, class Filter = detail::AcceptAll>
+		bool searchNode(size_t node, const VectorT &query, typename VectorT::Scalar rd, typename VectorT::Scalar *offsets, typename VectorT::Scalar &r2, LeafFnc &&fnc, Filter filter = Filter()) const
+		{
+			typedef typename VectorT::Scalar Scalar;
+
+			const Node &n = _nodes[node];
+
+			if (n.dim < 0) {
+				for (size_t i = 0; i < n.ids.size(); ++i) {
+					if (!filter(n.ids[i]))
+						continue;
+
+					const Scalar d = (query - _points[n.ids[i]]).squaredNorm();
+					if (d <= r2 && !fnc(n.ids[i], d, r2))
+						return false;
+				}
+				return true;
+			}
+
+			const Scalar diff = query(n.dim) - n.split;
+			const size_t nearChild = diff < 0 ? n.children[0] : n.children[1];
+			const size_t farChild = diff < 0 ? n.children[1] : n.children[0];
+
+			if (!searchNode(nearChild, query, rd, offsets, r2, fnc, filter))
+				return false;
+
+			const Scalar prevOffset = offsets[n.dim];
+			const Scalar cutDist = diff * diff;
+			rd += cutDist - prevOffset;
+
+			if (rd <= r2) {
+				offsets[n.dim] = cutDist;
+				const bool cont = searchNode(farChild, query, rd, offsets, r2, fnc, filter);
+				offsets[n.dim] = prevOffset;
+				return cont;
+			}
+
+			return true;
+		}
+
+		ArrayOfVectorT _points;
+		std::vector<size_t> _leafOf;
+		std::vector<Node> _nodes;
+		std::vector<size_t> _scratch;
+		size_t _leafSize;
+	};
+
+}
+
+#endif
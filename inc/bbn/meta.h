@@ -19,8 +19,19 @@
 #include <Eigen/Dense>
 #include <bbn/bruteforce_locator.h>
 #include <bbn/hashtable_locator.h>
+#include <bbn/grid_locator.h>
+#include <bbn/kdtree_locator.h>
 
 namespace bbn {
+
+	/** Available nearest neighbor locators. Used to select the locator of TaskTraits. */
+	enum LocatorKind {
+		BruteforceLocatorKind = 0,		/** Exhaustive search, see BruteforceLocator. */
+		HashtableLocatorKind = 1,		/** Bucket hashing, see HashtableLocator. */
+		GridLocatorKind = 2,			/** Cell-sorted grid optimized for bulk rebuilds, see GridLocator. */
+		KdTreeLocatorKind = 3			/** Bucketed kd-tree for high dimensional stacked vectors, see KdTreeLocator. */
+	};
+
 	namespace detail {
 
 		// Derive number of stacked dimensions.
@@ -49,16 +60,41 @@ namespace bbn {
 		};
 
 
-		template<typename Vector, bool UseAcceleration>
+		/* Locator type provider. Maps a LocatorKind to the corresponding locator for the given vector type. */
+		template<typename Vector, int Kind>
 		struct LocatorType {
 			typedef BruteforceLocator<Vector> type;
 		};
 
 		template<typename Vector>
-		struct LocatorType<Vector, true> {
+		struct LocatorType<Vector, HashtableLocatorKind> {
 			typedef HashtableLocator<Vector> type;
 		};
 
+		template<typename Vector>
+		struct LocatorType<Vector, GridLocatorKind> {
+			typedef GridLocator<Vector> type;
+		};
+
+		template<typename Vector>
+		struct LocatorType<Vector, KdTreeLocatorKind> {
+			typedef KdTreeLocator<Vector> type;
+		};
+
+		/* Tells whether a locator can move stored points in place through update(). Locators
+		   without this capability have to be rebuilt when points change. */
+		template<typename Locator>
+		struct LocatorSupportsUpdate { enum { value = 0 }; };
+
+		template<typename Vector>
+		struct LocatorSupportsUpdate< BruteforceLocator<Vector> > { enum { value = 1 }; };
+
+		template<typename Vector>
+		struct LocatorSupportsUpdate< HashtableLocator<Vector> > { enum { value = 1 }; };
+
+		template<typename Vector>
+		struct LocatorSupportsUpdate< KdTreeLocator<Vector> > { enum { value = 1 }; };
+
 
 	}
 }
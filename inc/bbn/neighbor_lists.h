@@ -0,0 +1,115 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_NEIGHBOR_LISTS_H
+#define BBN_NEIGHBOR_LISTS_H
+
+#include <vector>
+#include <algorithm>
+#include <Eigen/Dense>
+#include <bbn/parallel.h>
+
+namespace bbn {
+
+	/** Neighborhoods of multiple queries in compressed sparse row form. The neighbors of query i are stored
+		at positions [offsets[i], offsets[i + 1]) of indices and dists2. */
+	template<class Scalar>
+	struct NeighborLists {
+		std::vector<size_t> offsets;
+		std::vector<size_t> indices;
+		std::vector<Scalar> dists2;
+
+		/** Number of queries. */
+		size_t size() const
+		{
+			return offsets.empty() ? 0 : offsets.size() - 1;
+		}
+
+		/** Number of neighbors of the i-th query. */
+		size_t count(size_t i) const
+		{
+			return offsets[i + 1] - offsets[i];
+		}
+	};
+
+	/** Find all neighbors within radius for each column of queries using the locator's findAllWithinRadius.
+		Queries are processed in chunks distributed across the given number of threads, non-positive values use
+		all hardware threads. Locators should have been prepared for the radius, as concurrent queries cannot set
+		up per-radius state. Works with any locator. */
+	template<class Locator, class Derived>
+	NeighborLists<typename Derived::Scalar> findAllWithinRadiusBatch(const Locator &loc, const Eigen::MatrixBase<Derived> &queries, typename Derived::Scalar radius, int nThreads = 0)
+	{
+		typedef typename Derived::Scalar Scalar;
+		typedef Eigen::Matrix<Scalar, Derived::RowsAtCompileTime, 1> Vector;
+
+		struct Chunk {
+			std::vector<size_t> counts;
+			std::vector<size_t> indices;
+			std::vector<Scalar> dists2;
+		};
+
+		const size_t chunkSize = 256;
+		const size_t n = static_cast<size_t>(queries.cols());
+		const size_t nChunks = (n + chunkSize - 1) / chunkSize;
+
+		std::vector<Chunk> chunks(nChunks);
+		auto processChunk = [&](size_t c) {
+			Chunk &chunk = chunks[c];
+			std::vector<size_t> indices;
+			std::vector<Scalar> dists2;
+			Vector query;
+
+			const size_t end = std::min(n, (c + 1) * chunkSize);
+			for (size_t i = c * chunkSize; i < end; ++i) {
+				query = queries.col(static_cast<typename Derived::Index>(i));
+				loc.findAllWithinRadius(query, radius, indices, dists2);
+				chunk.counts.push_back(indices.size());
+				chunk.indices.insert(chunk.indices.end(), indices.begin(), indices.end());
+				chunk.dists2.insert(chunk.dists2.end(), dists2.begin(), dists2.end());
+			}
+		};
+
+		detail::parallelFor(nChunks, nThreads, processChunk);
+
+		// Concatenate chunks.
+		NeighborLists<Scalar> result;
+		result.offsets.resize(n + 1);
+		result.offsets[0] = 0;
+
+		std::vector<size_t> chunkOffsets(nChunks + 1, 0);
+		for (size_t c = 0; c < nChunks; ++c) {
+			chunkOffsets[c + 1] = chunkOffsets[c] + chunks[c].indices.size();
+		}
+
+		result.indices.resize(chunkOffsets[nChunks]);
+		result.dists2.resize(chunkOffsets[nChunks]);
+
+		detail::parallelFor(nChunks, nThreads, [&](size_t c) {
+			const Chunk &chunk = chunks[c];
+			std::copy(chunk.indices.begin(), chunk.indices.end(), result.indices.begin() + chunkOffsets[c]);
+			std::copy(chunk.dists2.begin(), chunk.dists2.end(), result.dists2.begin() + chunkOffsets[c]);
+
+			size_t offset = chunkOffsets[c];
+			for (size_t i = 0; i < chunk.counts.size(); ++i) {
+				offset += chunk.counts[i];
+				result.offsets[c * chunkSize + i + 1] = offset;
+			}
+		});
+
+		return result;
+	}
+}
+
+#endif
@@ -0,0 +1,196 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_PARALLEL_H
+#define BBN_PARALLEL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+namespace bbn {
+	namespace detail {
+
+		/* Resolve the number of worker threads to use. Non-positive values select the number of hardware threads. */
+		inline int numberOfThreads(int requested)
+		{
+			if (requested > 0)
+				return requested;
+
+			const int n = static_cast<int>(std::thread::hardware_concurrency());
+			return std::max(n, 1);
+		}
+
+		/* Number of workers parallelForWorkers uses for n work items. */
+		inline size_t numberOfWorkers(size_t n, int nThreads)
+		{
+			return std::max<size_t>(std::min<size_t>(static_cast<size_t>(numberOfThreads(nThreads)), n), 1);
+		}
+
+		/* Persistent worker threads shared by all parallel loops, so that loops invoked once per iteration do not
+		   pay for creating and joining threads. Threads are created on demand and live until program exit. The pool
+		   runs a single loop at a time, loops invoked concurrently or from within a worker are rejected. */
+		class ThreadPool {
+		public:
+			/* The pool shared by all parallel loops. */
+			static ThreadPool &instance()
+			{
+				static ThreadPool pool;
+				return pool;
+			}
+
+			~ThreadPool()
+			{
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_stop = true;
+				}
+				_wake.notify_all();
+				for (size_t t = 0; t < _threads.size(); ++t) {
+					_threads[t].join();
+				}
+			}
+
+			/* Invoke work(worker) once for each worker in [0, nWorkers). The calling thread runs worker zero. Returns
+			   false without invoking work if the pool is busy. */
+			template<class Work>
+			bool run(size_t nWorkers, Work &work)
+			{
+				std::unique_lock<std::mutex> busy(_busy, std::try_to_lock);
+				if (!busy.owns_lock())
+					return false;
+
+				std::unique_lock<std::mutex> lock(_mutex);
+				while (_threads.size() + 1 < nWorkers) {
+					const size_t index = _threads.size();
+					_threads.push_back(std::thread([this, index]() { loop(index); }));
+				}
+
+				_job = &invoke<Work>;
+				_jobData = &work;
+				_nJobThreads = nWorkers - 1;
+				_pending = nWorkers - 1;
+				++_generation;
+				lock.unlock();
+				_wake.notify_all();
+
+				work(size_t(0));
+
+				lock.lock();
+				_done.wait(lock, [this]() { return _pending == 0; });
+				return true;
+			}
+
+		private:
+			ThreadPool()
+				:_job(0), _jobData(0), _nJobThreads(0), _pending(0), _generation(0), _stop(false)
+			{}
+
+			template<class Work>
+			static void invoke(void *work, size_t worker)
+			{
+				(*static_cast<Work*>(work))(worker);
+			}
+
+			/* Wait for loops and run the worker of the given thread. */
+			void loop(size_t index)
+			{
+				size_t seen = 0;
+				std::unique_lock<std::mutex> lock(_mutex);
+				for (;;) {
+					_wake.wait(lock, [&]() { return _stop || _generation != seen; });
+					if (_stop)
+						return;
+
+					seen = _generation;
+					if (index >= _nJobThreads)
+						continue;
+
+					void (*job)(void*, size_t) = _job;
+					void *data = _jobData;
+					lock.unlock();
+					job(data, index + 1);
+					lock.lock();
+
+					if (--_pending == 0) {
+						_done.notify_one();
+					}
+				}
+			}
+
+			std::mutex _busy, _mutex;
+			std::condition_variable _wake, _done;
+			std::vector<std::thread> _threads;
+			void (*_job)(void*, size_t);
+			void *_jobData;
+			size_t _nJobThreads, _pending, _generation;
+			bool _stop;
+		};
+
+		/* Invoke fnc(i, worker) for all i in [0, n) using the given number of threads. Work items are handed out
+		   dynamically, so items of varying cost are balanced across threads. Worker is the index of the invoking
+		   worker in [0, numberOfWorkers(n, nThreads)) and allows accumulating into per-worker buffers without
+		   synchronization. The calling thread participates in the work as worker zero. Workers are taken from the
+		   shared ThreadPool. While the pool is busy with another loop, temporary threads are used instead. */
+		template<class Fnc>
+		void parallelForWorkers(size_t n, int nThreads, Fnc &&fnc)
+		{
+			const size_t nWorkers = numberOfWorkers(n, nThreads);
+
+			if (nWorkers <= 1) {
+				for (size_t i = 0; i < n; ++i) {
+					fnc(i, size_t(0));
+				}
+				return;
+			}
+
+			std::atomic<size_t> next(0);
+			auto work = [&](size_t worker) {
+				for (size_t i = next++; i < n; i = next++) {
+					fnc(i, worker);
+				}
+			};
+
+			if (ThreadPool::instance().run(nWorkers, work))
+				return;
+
+			std::vector<std::thread> threads;
+			threads.reserve(nWorkers - 1);
+			for (size_t t = 1; t < nWorkers; ++t) {
+				threads.push_back(std::thread(work, t));
+			}
+
+			work(0);
+
+			for (size_t t = 0; t < threads.size(); ++t) {
+				threads[t].join();
+			}
+		}
+
+		/* Invoke fnc(i) for all i in [0, n) using the given number of threads. Work items are handed out dynamically,
+		   so items of varying cost are balanced across threads. The calling thread participates in the work. */
+		template<class Fnc>
+		void parallelFor(size_t n, int nThreads, Fnc &&fnc)
+		{
+			parallelForWorkers(n, nThreads, [&](size_t i, size_t) { fnc(i); });
+		}
+
+	}
+}
+
+#endif
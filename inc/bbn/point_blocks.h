@@ -0,0 +1,215 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_POINT_BLOCKS_H
+#define BBN_POINT_BLOCKS_H
+
+#include <vector>
+#include <limits>
+#include <Eigen/Dense>
+#include <bbn/util.h>
+
+namespace bbn {
+	namespace detail {
+
+		/* Computes the squared distances between a query and n points stored in structure-of-arrays layout,
+		   i.e coordinate i of point j is located at coords[i * stride + j]. The kernel is evaluated one dimension
+		   at a time over all points using Eigen packet math, so that 8 (AVX2) or 16 (AVX-512) float candidates are
+		   processed per instruction when the compiler targets these instruction sets. Otherwise Eigen falls
+		   back to SSE or scalar code. Use N to specify the number of points at compile time. */
+		template<int N, class VectorT>
+		inline void squaredDistances(const VectorT &query, const typename VectorT::Scalar *coords, std::ptrdiff_t stride, typename VectorT::Index n, typename VectorT::Scalar *dists2)
+		{
+			typedef Eigen::Array<typename VectorT::Scalar, N, 1> ArrayN;
+
+			Eigen::Map<ArrayN> d(dists2, n);
+			d = (Eigen::Map<const ArrayN>(coords, n) - query(0)).square();
+			for (typename VectorT::Index i = 1; i < query.rows(); ++i) {
+				d += (Eigen::Map<const ArrayN>(coords + i * stride, n) - query(i)).square();
+			}
+		}
+
+		/* Pool of fixed size blocks that store points in structure-of-arrays layout. Blocks are chained into
+		   lists, allowing multiple containers (e.g buckets of a hashtable) to share a single pool without any
+		   per-container allocations. Within a chain only the head block is partially filled, all other blocks
+		   are full. Points are identified by the index they were inserted with. */
+		template<class VectorT>
+		class PointBlockPool {
+		public:
+			typedef typename VectorT::Scalar Scalar;
+			typedef typename VectorT::Index Index;
+
+			enum {
+				BlockSize = 16		/** Number of points per block. One block row fills an AVX-512 register of floats. */
+			};
+
+			/** Identifier of an invalid block, i.e an empty chain. */
+			static const size_t InvalidBlock = static_cast<size_t>(-1);
+
+			/** Construct empty pool. */
+			PointBlockPool()
+				:_dims(0)
+			{}
+
+			/** Release all blocks. */
+			void reset()
+			{
+				_coords.clear();
+				_ids.clear();
+				_counts.clear();
+				_next.clear();
+				_freeBlocks.clear();
+				_slotOf.clear();
+				_dims = 0;
+			}
+
+			/** Insert a point into the chain starting at head. Returns the new head of the chain. */
+			size_t insert(size_t head, size_t index, const VectorT &point)
+			{
+				if (_dims == 0) {
+					_dims = point.rows();
+				}
+
+				if (head == InvalidBlock || _counts[head] == static_cast<unsigned>(BlockSize)) {
+					const size_t block = allocateBlock();
+					_next[block] = head;
+					head = block;
+				}
+
+				if (index >= _slotOf.size()) {
+					_slotOf.resize(index + 1);
+				}
+
+				const size_t slot = head * BlockSize + _counts[head]++;
+				_ids[slot] = index;
+				_slotOf[index] = slot;
+				store(slot, point);
+
+				return head;
+			}
+
+			/** Overwrite the coordinates of a stored point. */
+			void set(size_t index, const VectorT &point)
+			{
+				store(_slotOf[index], point);
+			}
+
+			/** Remove a point from the chain starting at head. Returns the new head of the chain. */
+			size_t remove(size_t head, size_t index)
+			{
+				const size_t slot = _slotOf[index];
+				const size_t last = head * BlockSize + _counts[head] - 1;
+
+				if (slot != last) {
+					// Fill the gap with the last point of the chain.
+					const size_t moved = _ids[last];
+					_ids[slot] = moved;
+					_slotOf[moved] = slot;
+					for (Index i = 0; i < _dims; ++i) {
+						_coords[coordOffset(slot, i)] = _coords[coordOffset(last, i)];
+					}
+				}
+
+				if (--_counts[head] == 0) {
+					const size_t next = _next[head];
+					_freeBlocks.push_back(head);
+					head = next;
+				}
+
+				return head;
+			}
+
+			/** Visit all points of a chain whose squared distance to query is at most r2 and whose index is accepted
+				by the filter. The function receives the point index, its squared distance and a reference to r2 it
+				may shrink. Returns false to stop. Blocks without accepted points are skipped before computing their
+				distances. */
+			template<class Fnc, class Filter = AcceptAll>
+			inline bool visit(size_t head, const VectorT &query, Scalar &r2, Fnc &&fnc, Filter filter = Filter()) const
+			{
+				EIGEN_ALIGN16 Scalar dists2[BlockSize];
+
+				for (size_t block = head; block != InvalidBlock; block = _next[block]) {
+					const size_t *ids = &_ids[block * BlockSize];
+					const unsigned count = _counts[block];
+
+					unsigned first = 0;
+					while (first < count && !filter(ids[first])) {
+						++first;
+					}
+					if (first == count)
+						continue;
+
+					squaredDistances<BlockSize>(query, &_coords[block * _dims * BlockSize], BlockSize, BlockSize, dists2);
+
+					for (unsigned i = first; i < count; ++i) {
+						if (dists2[i] <= r2 && filter(ids[i]) && !fnc(ids[i], dists2[i], r2))
+							return false;
+					}
+				}
+
+				return true;
+			}
+
+		private:
+
+			/* Location of the i-th coordinate of the point in the given slot. */
+			inline size_t coordOffset(size_t slot, Index i) const
+			{
+				return ((slot / BlockSize) * _dims + i) * BlockSize + slot % BlockSize;
+			}
+
+			/* Write point coordinates to slot. */
+			inline void store(size_t slot, const VectorT &point)
+			{
+				for (Index i = 0; i < _dims; ++i) {
+					_coords[coordOffset(slot, i)] = point(i);
+				}
+			}
+
+			/* Provide an empty block. */
+			size_t allocateBlock()
+			{
+				size_t block;
+				if (!_freeBlocks.empty()) {
+					block = _freeBlocks.back();
+					_freeBlocks.pop_back();
+				} else {
+					block = _counts.size();
+					_coords.resize(_coords.size() + _dims * BlockSize, Scalar(0));
+					_ids.resize(_ids.size() + BlockSize);
+					_counts.push_back(0);
+					_next.push_back(InvalidBlock);
+				}
+
+				_counts[block] = 0;
+				return block;
+			}
+
+			std::vector<Scalar, Eigen::aligned_allocator<Scalar> > _coords;
+			std::vector<size_t> _ids;
+			std::vector<unsigned> _counts;
+			std::vector<size_t> _next;
+			std::vector<size_t> _freeBlocks;
+			std::vector<size_t> _slotOf;
+			Index _dims;
+		};
+
+		template<class VectorT>
+		const size_t PointBlockPool<VectorT>::InvalidBlock;
+
+	}
+}
+
+#endif
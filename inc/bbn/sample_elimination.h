@@ -0,0 +1,292 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_SAMPLE_ELIMINATION_H
+#define BBN_SAMPLE_ELIMINATION_H
+
+#include <Eigen/Dense>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <bbn/task_traits.h>
+#include <bbn/neighbor_lists.h>
+#include <bbn/util.h>
+
+namespace bbn {
+
+    /** Resample by weighted sample elimination (Yuksel 2015).
+
+		All input samples are candidates. Each candidate is weighted by the proximity of its neighbors and the
+		heaviest candidate is removed repeatedly until the requested number of samples remains. Neighbor weights
+		are updated on every removal, so that the remaining samples are well spread. In contrast to dart throwing,
+		the output size is specified directly and no conflict radius needs to be tuned. */
+	template<class Traits>
+    class SampleElimination {
+    public:
+
+		typedef typename Traits::Scalar Scalar;
+		typedef typename Traits::Vector Vector;
+		typedef typename Traits::Matrix Matrix;
+
+        /** Default constructor. */
+		SampleElimination()
+			: _alpha(8), _beta(Scalar(0.65)), _gamma(Scalar(1.5)), _maxRadius(0), _domainDims(0), _nThreads(1)
+        {}
+
+		/** Set the exponent of the weight function. Defaults to 8. */
+		void setWeightExponent(Scalar alpha) {
+			_alpha = alpha;
+		}
+
+		/** Set the parameters of weight limiting, which reduces the influence of very close neighbors.
+			Defaults to beta 0.65 and gamma 1.5. A beta of zero disables weight limiting. */
+		void setWeightLimiting(Scalar beta, Scalar gamma) {
+			_beta = beta;
+			_gamma = gamma;
+		}
+
+		/** Set the maximum Poisson disk radius of the output. Neighbors up to twice this radius contribute to weights.
+			When zero, which is the default, the radius is estimated from the input and the requested output size. */
+		void setMaximumRadius(Scalar r) {
+			_maxRadius = r;
+		}
+
+		/** Set the number of dimensions of the domain the input samples are distributed over, which determines the
+			estimated maximum radius. Points sampled from a surface have two dimensions regardless of their stacked
+			dimensions. When zero, which is the default, the dimensions are estimated from the growth of neighborhoods. */
+		void setDomainDimensions(int d) {
+			_domainDims = d;
+		}
+
+		/** Set the number of threads used for gathering neighbors. Non-positive values use all hardware threads. Defaults to one. */
+		void setNumberOfThreads(int n) {
+			_nThreads = n;
+		}
+
+		/* Set parameters specific to traits. */
+		void setTaskTraits(const Traits &t) {
+			_traits = t;
+		}
+
+        /** Resample the input samples down to nSamples samples. Remaining samples are written in input order. */
+		template<typename VectorInputIterator, typename VectorOutputIterator>
+		bool resample(VectorInputIterator samplesBegin, VectorInputIterator samplesEnd, size_t nSamples, VectorOutputIterator outputIter)
+        {
+			const size_t nElements = static_cast<size_t>(std::distance(samplesBegin, samplesEnd));
+			if (nElements == 0 || nSamples == 0)
+				return false;
+
+			Matrix samples(_traits.getStackedDims(), nElements);
+			VectorInputIterator sampleIter = samplesBegin;
+			for (size_t i = 0; i < nElements; ++i) {
+				samples.col(i) = *sampleIter++;
+			}
+
+			if (nSamples >= nElements) {
+				for (size_t i = 0; i < nElements; ++i) {
+					*outputIter++ = samples.col(i);
+				}
+				return true;
+			}
+
+			const Scalar rMax = (_maxRadius > 0) ? _maxRadius : estimateMaximumRadius(samples, nSamples);
+			const Scalar rMin = rMax * _beta * (1 - std::pow(Scalar(nSamples) / Scalar(nElements), _gamma));
+			const Scalar twoRMax = 2 * rMax;
+
+			typename Traits::Locator loc(_traits.getLocatorParams());
+			loc.prepare(twoRMax);
+			loc.build(samples);
+			const NeighborLists<Scalar> neighbors = findAllWithinRadiusBatch(loc, samples, twoRMax, _nThreads);
+
+			// Weight contributed by each neighbor.
+			std::vector<Scalar> neighborWeights(neighbors.indices.size());
+			for (size_t k = 0; k < neighbors.indices.size(); ++k) {
+				const Scalar d = std::max(std::sqrt(neighbors.dists2[k]), 2 * rMin);
+				neighborWeights[k] = std::pow(1 - std::min(d, twoRMax) / twoRMax, _alpha);
+			}
+
+			std::vector<Scalar> weights(nElements, Scalar(0));
+			for (size_t i = 0; i < nElements; ++i) {
+				for (size_t k = neighbors.offsets[i]; k < neighbors.offsets[i + 1]; ++k) {
+					if (neighbors.indices[k] != i) {
+						weights[i] += neighborWeights[k];
+					}
+				}
+			}
+
+			// Repeatedly remove the heaviest sample and discount its contribution from its neighbors.
+			WeightHeap heap(weights);
+			std::vector<char> removed(nElements, 0);
+			size_t nRemaining = nElements;
+			while (nRemaining > nSamples) {
+				const size_t i = heap.pop();
+				removed[i] = 1;
+				--nRemaining;
+
+				for (size_t k = neighbors.offsets[i]; k < neighbors.offsets[i + 1]; ++k) {
+					const size_t j = neighbors.indices[k];
+					if (j == i || removed[j])
+						continue;
+
+					heap.decrease(j, neighborWeights[k]);
+				}
+
+				if (nRemaining % 5000 == 0) {
+					BBN_LOG("Sample elimination %.2f%% - %d samples remaining\r",
+						(float)(nElements - nRemaining) / (nElements - nSamples) * 100, (int)nRemaining);
+				}
+			}
+
+			BBN_LOG("Sample elimination 100.00%% - %d samples remaining\n", (int)nRemaining);
+
+			for (size_t i = 0; i < nElements; ++i) {
+				if (!removed[i]) {
+					*outputIter++ = samples.col(i);
+				}
+			}
+
+			return true;
+        }
+
+    private:
+
+		/* Binary max-heap over sample weights that tracks the position of each sample, so that the weight of
+		   a sample can be decreased in logarithmic time. */
+		class WeightHeap {
+		public:
+			WeightHeap(std::vector<Scalar> &weights)
+				:_weights(weights), _heap(weights.size()), _pos(weights.size())
+			{
+				for (size_t i = 0; i < _heap.size(); ++i) {
+					_heap[i] = i;
+					_pos[i] = i;
+				}
+				for (size_t i = _heap.size() / 2; i > 0; --i) {
+					siftDown(i - 1);
+				}
+			}
+
+			/* Remove and return the sample of largest weight. */
+			size_t pop()
+			{
+				const size_t top = _heap.front();
+				swap(0, _heap.size() - 1);
+				_heap.pop_back();
+				if (!_heap.empty()) {
+					siftDown(0);
+				}
+				return top;
+			}
+
+			/* Decrease the weight of a sample still in the heap. */
+			void decrease(size_t i, Scalar w)
+			{
+				_weights[i] -= w;
+				siftDown(_pos[i]);
+			}
+
+		private:
+			void swap(size_t a, size_t b)
+			{
+				std::swap(_heap[a], _heap[b]);
+				_pos[_heap[a]] = a;
+				_pos[_heap[b]] = b;
+			}
+
+			void siftDown(size_t p)
+			{
+				const size_t n = _heap.size();
+				for (;;) {
+					size_t largest = p;
+					const size_t l = 2 * p + 1, r = 2 * p + 2;
+					if (l < n && _weights[_heap[l]] > _weights[_heap[largest]]) largest = l;
+					if (r < n && _weights[_heap[r]] > _weights[_heap[largest]]) largest = r;
+					if (largest == p)
+						return;
+					swap(p, largest);
+					p = largest;
+				}
+			}
+
+			std::vector<Scalar> &_weights;
+			std::vector<size_t> _heap, _pos;
+		};
+
+		/* Estimate the maximum Poisson disk radius for n samples. The radius of a ball containing the fraction of
+		   input samples that each output sample represents is determined at random probes. Their median is converted
+		   to the radius of the densest known packing of balls in the domain, whose cells cover the same volume. */
+		Scalar estimateMaximumRadius(const Matrix &samples, size_t n) const
+		{
+			const size_t nElements = static_cast<size_t>(samples.cols());
+			const size_t nProbes = std::min<size_t>(nElements, 64);
+			const size_t k = std::min(nElements - 1, (nElements + n - 1) / n);
+			const size_t kDims = std::min(nElements - 1, std::max<size_t>(k, 32));
+
+			std::vector<Scalar> radii(nProbes), dims(nProbes);
+			std::vector<Scalar> dists2(nElements);
+			for (size_t p = 0; p < nProbes; ++p) {
+				const size_t probe = (p * nElements) / nProbes;
+				Eigen::Map< Eigen::Matrix<Scalar, 1, Eigen::Dynamic> >(&dists2[0], nElements) =
+					(samples.colwise() - samples.col(probe)).colwise().squaredNorm();
+				std::nth_element(dists2.begin(), dists2.begin() + kDims, dists2.end());
+
+				// Samples grow with r^d around the probe, so halving the radius of kDims neighbors leaves 2^-d of them.
+				const Scalar quarter2 = dists2[kDims] * Scalar(0.25);
+				const size_t inner = std::max<size_t>(std::count_if(dists2.begin(), dists2.begin() + kDims, [&](Scalar d2) { return d2 <= quarter2; }), 1);
+				dims[p] = std::log(Scalar(kDims) / Scalar(inner)) / std::log(Scalar(2));
+
+				std::nth_element(dists2.begin(), dists2.begin() + k, dists2.begin() + kDims + 1);
+				radii[p] = std::sqrt(dists2[k]);
+			}
+
+			std::nth_element(radii.begin(), radii.begin() + nProbes / 2, radii.end());
+			std::nth_element(dims.begin(), dims.begin() + nProbes / 2, dims.end());
+
+			int d = _domainDims;
+			if (d <= 0) {
+				d = static_cast<int>(std::floor(dims[nProbes / 2] + Scalar(0.5)));
+				d = std::min(std::max(d, 1), static_cast<int>(samples.rows()));
+			}
+
+			// A ball of radius r covers a volume of V_d * r^d / density per sample.
+			return radii[nProbes / 2] * std::pow(packingDensity(d), Scalar(1) / Scalar(d));
+		}
+
+		/* Density of the densest known packing of balls in d dimensions. Beyond eight dimensions the
+		   Minkowski-Hlawka bound is used. */
+		static Scalar packingDensity(int d)
+		{
+			const Scalar pi = Scalar(3.14159265358979);
+			switch (d) {
+			case 1: return Scalar(1);
+			case 2: return pi / (2 * std::sqrt(Scalar(3)));
+			case 3: return pi / (3 * std::sqrt(Scalar(2)));
+			case 4: return pi * pi / 16;
+			case 5: return pi * pi / (15 * std::sqrt(Scalar(2)));
+			case 6: return pi * pi * pi / (48 * std::sqrt(Scalar(3)));
+			case 7: return pi * pi * pi / 105;
+			case 8: return pi * pi * pi * pi / 384;
+			default: return std::pow(Scalar(2), Scalar(1 - d));
+			}
+		}
+
+		Scalar _alpha, _beta, _gamma, _maxRadius;
+		int _domainDims;
+		int _nThreads;
+		Traits _traits;
+    };
+}
+
+#endif
@@ -0,0 +1,71 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_SCRATCH_H
+#define BBN_SCRATCH_H
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+namespace bbn {
+	namespace detail {
+
+		/* Array of a size known at runtime that is stored inline up to N elements and on the heap beyond. Used as
+		   per-query scratch space of dynamically sized vectors, so that queries in up to N dimensions do not
+		   allocate. */
+		template<class T, int N>
+		class ScratchArray {
+		public:
+			/** Construct array of n uninitialized elements. */
+			explicit ScratchArray(size_t n)
+				:_data(_local)
+			{
+				if (n > static_cast<size_t>(N)) {
+					_heap.resize(n);
+					_data = &_heap[0];
+				}
+			}
+
+			/** Construct array of n elements set to value. */
+			ScratchArray(size_t n, const T &value)
+				:_data(_local)
+			{
+				if (n > static_cast<size_t>(N)) {
+					_heap.resize(n);
+					_data = &_heap[0];
+				}
+				std::fill(_data, _data + n, value);
+			}
+
+			inline T *data() { return _data; }
+			inline const T *data() const { return _data; }
+
+			inline T &operator[](size_t i) { return _data[i]; }
+			inline const T &operator[](size_t i) const { return _data[i]; }
+
+		private:
+			ScratchArray(const ScratchArray &);
+			ScratchArray &operator=(const ScratchArray &);
+
+			T _local[N];
+			std::vector<T> _heap;
+			T *_data;
+		};
+
+	}
+}
+
+#endif
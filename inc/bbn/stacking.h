@@ -71,6 +71,16 @@ namespace bbn {
 			return s;
 		}
 
+		/** Stack columns of positions and features into the columns of stacked. Stacked needs to provide
+			as many columns as positions and features and is not resized. Stacked may be a block expression. */
+		template<class PositionMatrix, class FeatureMatrix, class StackedMatrix>
+		inline void operator() (const Eigen::MatrixBase<PositionMatrix> &p, const Eigen::MatrixBase<FeatureMatrix> &f, const Eigen::MatrixBase<StackedMatrix> &stacked)
+		{
+			Eigen::MatrixBase<StackedMatrix> &s = const_cast<Eigen::MatrixBase<StackedMatrix> &>(stacked);
+			s.topRows(p.rows()) = p * _wPosition;
+			s.middleRows(p.rows(), f.rows()) = f * _wFeature;
+		}
+
 	private:
 		typename result_type::Scalar _wPosition, _wFeature;
 	};
@@ -24,10 +24,10 @@ namespace bbn {
 	
 	/** Traits and options for working with algorithms. */
 	template<
-		typename Scalar,								/** Scalar value type. I.e float, double, ... */
+		typename ScalarType,							/** Scalar value type. I.e float, double, ... */
 		int PositionDims = Eigen::Dynamic,				/** Number of positional dimensions at compile time. */
 		int FeatureDims = Eigen::Dynamic,				/** Number of positional dimensions at compile time. */
-		bool UseAcceleration = true						/** Use acceleration structures for faster nearest neighbor queries. */
+		int LocatorImpl = HashtableLocatorKind			/** Locator used for nearest neighbor queries, see LocatorKind. Boolean values select bruteforce (false) or hashtable (true) search. */
 	> class TaskTraits
 	{
 	public:
@@ -37,7 +37,7 @@ namespace bbn {
 			StackedDimsAtCompileTime = detail::StackedSizeAtCompileTime<PositionDims, FeatureDims>::size
 		};
 
-		typedef Scalar Scalar;																		/** Scalar type */
+		typedef ScalarType Scalar;																	/** Scalar type */
 		typedef typename Eigen::Matrix<Scalar, StackedDimsAtCompileTime, 1> Vector;					/** Vector type (position + feature) */
 		typedef typename Eigen::Ref<Vector> VectorLike;												/** Vector type (position + feature) */
 		typedef typename Eigen::Matrix<
@@ -45,7 +45,7 @@ namespace bbn {
 			StackedDimsAtCompileTime, 
 			Eigen::Dynamic,
 			Eigen::ColMajor> Matrix;																/** Matrix type holding n Vectors in rows */
-		typedef typename detail::LocatorType<Vector, UseAcceleration>::type Locator;				/** Locator type */
+		typedef typename detail::LocatorType<Vector, LocatorImpl>::type Locator;				/** Locator type */
 
 		TaskTraits()
 			: _posDims(0), _featureDims(0)
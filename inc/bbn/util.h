@@ -16,6 +16,7 @@
 #ifndef BBN_UTIL_H
 #define BBN_UTIL_H
 
+#include <cstddef>
 
 #if BBN_VERBOSE_OUTPUT
     #include <stdio.h>
@@ -24,4 +25,18 @@
     #define BBN_LOG(...)
 #endif
 
+namespace bbn {
+	namespace detail {
+
+		/* Index filter of neighbor queries that accepts every index. */
+		struct AcceptAll {
+			inline bool operator()(size_t) const
+			{
+				return true;
+			}
+		};
+
+	}
+}
+
 #endif
\ No newline at end of file
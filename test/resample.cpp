@@ -42,11 +42,25 @@ public:
 		return _s(_points[pointId], _normals[pointId]);				
 	}
 
+	size_t operator()(R3Traits::Matrix &block) {
+		const size_t n = std::min<size_t>(block.cols(), _sampleIndices.size() - _index);
+		_blockPoints.resize(3, n);
+		_blockNormals.resize(3, n);
+		for (size_t i = 0; i < n; ++i) {
+			size_t pointId = _sampleIndices[_index++];
+			_blockPoints.col(i) = _points[pointId];
+			_blockNormals.col(i) = _normals[pointId];
+		}
+		_s(_blockPoints, _blockNormals, block.leftCols(n));
+		return n;
+	}
+
 private:
 	std::vector<size_t> _sampleIndices;
 	ArrayOfVector &_points, &_normals;
 	Stacker &_s;
 	size_t _index;
+	Eigen::Matrix3Xf _blockPoints, _blockNormals;
 };
 
 int main(int argc, const char **argv) {
@@ -79,17 +93,19 @@ int main(int argc, const char **argv) {
 	adt.setTaskTraits(traits);
 	adt.setConflictRadius(0.01f);
 	adt.setMaximumAttempts(points.size());
+	adt.setMaximumConsecutiveFailures(10000); // Stop early once the sample set has saturated.
 
 	Stacker stacker(Stacker::Params(1.0f, 0.09f));
 
 	PointSampler sampler(points, normals, stacker);
 	std::vector<R3Traits::Vector> sampled;
     
-	if (!adt.resample(sampler, std::back_inserter(sampled))) {
+	if (!adt.resampleBlocks(sampler, std::back_inserter(sampled))) {
         std::cerr << "Failed to throw darts." << std::endl;
     }
 
 	bbn::HashtableLocator<Eigen::Vector3f> ploc;
+	ploc.prepare(0.01f);
 	ploc.add(points.begin(), points.end());
 
 	/*
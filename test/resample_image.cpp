@@ -66,6 +66,14 @@ public:
 		v(2) = _disWeight(_gen) / 2.f;
 		return v;
 	}
+
+	ImageTraits::Vector operator()(const bbn::DartThrowing<ImageTraits>::PositionVector &p) {
+		ImageTraits::Vector v(3);
+		v(0) = p(0);
+		v(1) = p(1);
+		v(2) = _disWeight(_gen) / 2.f;
+		return v;
+	}
 private:
 	std::random_device _rd;
 	std::mt19937 _gen;
@@ -84,11 +92,11 @@ int main(int argc, const char **argv)
 	bbn::DartThrowing<ImageTraits> adt;
 	adt.setTaskTraits(it);
 	adt.setConflictRadius(0.08f);
-	adt.setMaximumAttempts(100000);	
 	
 	std::vector<ImageTraits::Vector> sampled;
+	const Eigen::Vector2f lower(0, 0), upper(1, 1);
     
-	if (!adt.resample(sampler, std::back_inserter(sampled))) {
+	if (!adt.resampleMaximal(lower, upper, sampler, std::back_inserter(sampled))) {
         std::cerr << "Failed to throw darts." << std::endl;
     }
 
@@ -101,17 +109,17 @@ int main(int argc, const char **argv)
 	em.setKernelSigma(0.03f);
 	em.setStepSize(0.45f * 0.03f * 0.03f);
 	em.setMaximumSearchRadius(0.2f);
+	em.setStepSchedule(bbn::EnergyMinimization<ImageTraits>::BarzilaiBorweinStep);
+	em.setMinimumRelativeEnergyDecrease(1e-4f); // Stop once converged.
 
-	while (true) {
-		em.minimize(sampled.begin(), sampled.end(), sampled.begin(), [&](ImageTraits::VectorLike p) {
-			p.x() = std::max<float>(0, std::min<float>(p.x(), 1));
-			p.y() = std::max<float>(0, std::min<float>(p.y(), 1));
-		}, 1);
+	em.minimize(sampled.begin(), sampled.end(), sampled.begin(), [&](ImageTraits::VectorLike p) {
+		p.x() = std::max<float>(0, std::min<float>(p.x(), 1));
+		p.y() = std::max<float>(0, std::min<float>(p.y(), 1));
+	}, 1000);
 
-		img = createImage(sampled, imageSize);
-		cv::imshow("result", img);
-		cv::waitKey();
-	}
+	img = createImage(sampled, imageSize);
+	cv::imshow("result", img);
+	cv::waitKey();
 
     
     return 0;
@@ -0,0 +1,389 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "test_util.h"
+#include <bbn/dart_throwing.h>
+#include <bbn/task_traits.h>
+
+typedef bbn::TaskTraits<float, 2, 1> PlaneTraits;
+typedef bbn::TaskTraits<float, 3, 3> SurfelTraits;
+typedef std::vector<PlaneTraits::Vector, Eigen::aligned_allocator<PlaneTraits::Vector> > ArrayOfVector;
+typedef std::vector<SurfelTraits::Vector, Eigen::aligned_allocator<SurfelTraits::Vector> > ArrayOfSurfel;
+
+/* Uniform darts in the unit square with a feature dimension scaled by featureScale. Counts the darts drawn. */
+class UniformSampler {
+public:
+	UniformSampler(unsigned seed, float featureScale = 0.2f)
+		:_rnd(seed), _featureScale(featureScale), _count(0)
+	{}
+
+	PlaneTraits::Vector operator()()
+	{
+		PlaneTraits::Vector v;
+		v << _rnd(), _rnd(), _rnd() * _featureScale;
+		++_count;
+		return v;
+	}
+
+	size_t count() const {
+		return _count;
+	}
+
+private:
+	bbn_test::Random _rnd;
+	float _featureScale;
+	size_t _count;
+};
+
+/* Uniform darts in the unit cube with three feature dimensions scaled by featureScale. */
+class SurfelSampler {
+public:
+	SurfelSampler(unsigned seed, float featureScale)
+		:_rnd(seed), _featureScale(featureScale)
+	{}
+
+	SurfelTraits::Vector operator()()
+	{
+		SurfelTraits::Vector v;
+		v << _rnd(), _rnd(), _rnd(), _rnd() * _featureScale, _rnd() * _featureScale, _rnd() * _featureScale;
+		return v;
+	}
+
+private:
+	bbn_test::Random _rnd;
+	float _featureScale;
+};
+
+/* Fills blocks with the darts of a uniform sampler. */
+class BlockSampler {
+public:
+	BlockSampler(unsigned seed)
+		:_sampler(seed)
+	{}
+
+	size_t operator()(PlaneTraits::Matrix &block)
+	{
+		for (PlaneTraits::Matrix::Index i = 0; i < block.cols(); ++i) {
+			block.col(i) = _sampler();
+		}
+		return static_cast<size_t>(block.cols());
+	}
+
+	size_t count() const {
+		return _sampler.count();
+	}
+
+private:
+	UniformSampler _sampler;
+};
+
+/* Configure dart throwing with a hashtable locator matching the conflict radius. */
+bbn::DartThrowing<PlaneTraits> makeDartThrowing(float radius, size_t nAttempts)
+{
+	PlaneTraits traits;
+	PlaneTraits::Locator::Params params;
+	params.bucketResolution = radius;
+	traits.setLocatorParams(params);
+
+	bbn::DartThrowing<PlaneTraits> dt;
+	dt.setTaskTraits(traits);
+	dt.setConflictRadius(radius);
+	dt.setMaximumAttempts(nAttempts);
+	return dt;
+}
+
+/* Parallel dart throwing keeps the minimum distance of sequential dart throwing and yields a similar number
+   of samples from the same number of attempts. */
+void testParallel()
+{
+	const float radius = 0.05f;
+	const size_t nAttempts = 4000;
+
+	bbn::DartThrowing<PlaneTraits> dt = makeDartThrowing(radius, nAttempts);
+	UniformSampler sequentialSampler(1);
+	ArrayOfVector sequential;
+	BBN_CHECK(dt.resample(sequentialSampler, std::back_inserter(sequential)));
+	BBN_CHECK(bbn_test::minimumSpacing(sequential.begin(), sequential.end()) > radius);
+
+	const int threads[] = { 2, 4 };
+	for (int t = 0; t < 2; ++t) {
+		dt.setNumberOfThreads(threads[t]);
+		UniformSampler sampler(1);
+		ArrayOfVector parallel;
+		BBN_CHECK(dt.resample(sampler, std::back_inserter(parallel)));
+		BBN_CHECK(dt.getStopReason() == bbn::DartThrowing<PlaneTraits>::StopMaximumAttempts);
+		BBN_CHECK(bbn_test::minimumSpacing(parallel.begin(), parallel.end()) > radius);
+		BBN_CHECK_CLOSE(float(parallel.size()), float(sequential.size()), 0.1f);
+	}
+}
+
+/* Saturation criteria stop resampling long before the maximum number of attempts and report why they stopped. */
+void testStopReasons()
+{
+	typedef bbn::DartThrowing<PlaneTraits> DT;
+	const float radius = 0.1f;
+	const size_t nAttempts = 200000;
+
+	DT dt = makeDartThrowing(radius, 2000);
+	BBN_CHECK(dt.getStopReason() == DT::StopNotRun);
+
+	UniformSampler limited(2);
+	ArrayOfVector samples;
+	BBN_CHECK(dt.resample(limited, std::back_inserter(samples)));
+	BBN_CHECK(dt.getStopReason() == DT::StopMaximumAttempts);
+	BBN_CHECK(limited.count() == 2000);
+
+	dt.setMaximumAttempts(nAttempts);
+	dt.setMaximumConsecutiveFailures(500);
+	UniformSampler failures(2);
+	samples.clear();
+	BBN_CHECK(dt.resample(failures, std::back_inserter(samples)));
+	BBN_CHECK(dt.getStopReason() == DT::StopConsecutiveFailures);
+	BBN_CHECK(failures.count() < nAttempts / 4);
+	BBN_CHECK(bbn_test::minimumSpacing(samples.begin(), samples.end()) > radius);
+
+	dt.setMaximumConsecutiveFailures(0);
+	dt.setMinimumAcceptanceRate(0.01f, 500);
+	UniformSampler rate(2);
+	samples.clear();
+	BBN_CHECK(dt.resample(rate, std::back_inserter(samples)));
+	BBN_CHECK(dt.getStopReason() == DT::StopAcceptanceRate);
+	BBN_CHECK(rate.count() < nAttempts / 4);
+	BBN_CHECK(rate.count() % 500 == 0);
+}
+
+/* Lift positions to stacked vectors with a zero feature. */
+PlaneTraits::Vector liftPosition(const Eigen::Vector2f &p)
+{
+	PlaneTraits::Vector v;
+	v << p, 0.f;
+	return v;
+}
+
+/* Maximal sampling covers the entire domain with the conflict radius while keeping samples apart. */
+void testMaximal()
+{
+	typedef bbn::DartThrowing<PlaneTraits> DT;
+	const float radius = 0.05f;
+
+	DT dt = makeDartThrowing(radius, 0);
+	dt.setSeed(3);
+
+	ArrayOfVector samples;
+	BBN_CHECK(dt.resampleMaximal(Eigen::Vector2f(0, 0), Eigen::Vector2f(1, 0.5f), liftPosition, std::back_inserter(samples)));
+	BBN_CHECK(dt.getStopReason() == DT::StopCoverageComplete);
+	BBN_CHECK(bbn_test::minimumSpacing(samples.begin(), samples.end()) > radius);
+
+	bool inside = true;
+	for (size_t i = 0; i < samples.size(); ++i) {
+		inside &= samples[i](0) >= 0 && samples[i](0) <= 1 && samples[i](1) >= 0 && samples[i](1) <= 0.5f;
+	}
+	BBN_CHECK(inside);
+
+	// No position of the domain is left uncovered.
+	int uncovered = 0;
+	for (int y = 0; y <= 50; ++y) {
+		for (int x = 0; x <= 100; ++x) {
+			const PlaneTraits::Vector p = liftPosition(Eigen::Vector2f(x * 0.01f, y * 0.01f));
+			float best2 = std::numeric_limits<float>::infinity();
+			for (size_t i = 0; i < samples.size(); ++i) {
+				best2 = std::min(best2, (samples[i] - p).squaredNorm());
+			}
+			uncovered += best2 > radius * radius ? 1 : 0;
+		}
+	}
+	BBN_CHECK(uncovered == 0);
+}
+
+/* Searching the conflict radius for a target count reaches the target within tolerance, also when feature
+   dimensions contribute to the conflict distance, and keeps the samples apart by the final radius. */
+void testResampleToCount()
+{
+	const float featureScales[] = { 0.f, 1.f };
+	for (int f = 0; f < 2; ++f) {
+		SurfelTraits traits;
+		SurfelTraits::Locator::Params params;
+		params.bucketResolution = 0.2f;
+		traits.setLocatorParams(params);
+
+		bbn::DartThrowing<SurfelTraits> dt;
+		dt.setTaskTraits(traits);
+		dt.setConflictRadius(0.05f);
+		dt.setMaximumAttempts(10000);
+
+		SurfelSampler sampler(5, featureScales[f]);
+		ArrayOfSurfel samples;
+		BBN_CHECK(dt.resampleToCount(sampler, 150, 0.1f, std::back_inserter(samples)));
+		BBN_CHECK(samples.size() >= 135 && samples.size() <= 165);
+		BBN_CHECK(dt.getConflictRadius() > 0.05f && dt.getConflictRadius() < 1.f);
+		BBN_CHECK(bbn_test::minimumSpacing(samples.begin(), samples.end()) > dt.getConflictRadius());
+	}
+}
+
+/* Conflict radius growing along the first dimension. */
+struct RampRadius {
+	float operator()(const PlaneTraits::Vector &v) const {
+		return 0.03f + 0.05f * v(0);
+	}
+};
+
+/* Darts with varying radii keep the larger radius of every pair apart and coarse regions receive fewer samples
+   than sampling everywhere at the finest radius. */
+void testVariableRadius()
+{
+	const size_t nAttempts = 4000;
+	RampRadius radius;
+
+	bbn::DartThrowing<PlaneTraits> dt = makeDartThrowing(0.03f, nAttempts);
+	UniformSampler sampler(4);
+	ArrayOfVector samples;
+	BBN_CHECK(dt.resample(sampler, radius, std::back_inserter(samples)));
+
+	bool spaced = true;
+	for (size_t i = 0; i < samples.size(); ++i) {
+		for (size_t j = i + 1; j < samples.size(); ++j) {
+			const float r = std::max(radius(samples[i]), radius(samples[j]));
+			spaced &= (samples[i] - samples[j]).norm() > r;
+		}
+	}
+	BBN_CHECK(spaced);
+
+	size_t left = 0;
+	for (size_t i = 0; i < samples.size(); ++i) {
+		left += samples[i](0) < 0.5f ? 1 : 0;
+	}
+	BBN_CHECK(left > samples.size() - left);
+
+	UniformSampler fineSampler(4);
+	ArrayOfVector fine;
+	BBN_CHECK(dt.resample(fineSampler, std::back_inserter(fine)));
+	BBN_CHECK(samples.size() < fine.size() / 2);
+}
+
+/* Block samplers yield the same samples as drawing darts one by one and are never asked for more darts than
+   the maximum number of attempts. */
+void testBlocks()
+{
+	const size_t nAttempts = 1000;
+	bbn::DartThrowing<PlaneTraits> dt = makeDartThrowing(0.05f, nAttempts);
+	dt.setBlockSize(300);
+
+	UniformSampler sampler(6);
+	ArrayOfVector samples;
+	BBN_CHECK(dt.resample(sampler, std::back_inserter(samples)));
+
+	BlockSampler blockSampler(6);
+	ArrayOfVector blockSamples;
+	BBN_CHECK(dt.resampleBlocks(blockSampler, std::back_inserter(blockSamples)));
+	BBN_CHECK(blockSampler.count() == nAttempts);
+	BBN_CHECK(blockSamples.size() == samples.size());
+	BBN_CHECK(std::equal(samples.begin(), samples.end(), blockSamples.begin()));
+}
+
+/* Samples of the first k levels of progressive sampling are spaced by the radius of level k and all levels
+   together draw no more darts than the maximum number of attempts. */
+void testProgressive()
+{
+	const size_t nAttempts = 3000;
+	bbn::DartThrowing<PlaneTraits> dt = makeDartThrowing(0.03f, nAttempts);
+
+	std::vector<float> radii;
+	radii.push_back(0.12f);
+	radii.push_back(0.06f);
+	radii.push_back(0.03f);
+
+	UniformSampler sampler(7);
+	ArrayOfVector samples;
+	std::vector<int> levels;
+	BBN_CHECK(dt.resampleProgressive(sampler, radii, std::back_inserter(samples), std::back_inserter(levels)));
+	BBN_CHECK(sampler.count() <= nAttempts);
+	BBN_CHECK(levels.size() == samples.size());
+	BBN_CHECK(std::is_sorted(levels.begin(), levels.end()));
+
+	for (int level = 0; level < 3; ++level) {
+		const size_t prefix = std::upper_bound(levels.begin(), levels.end(), level) - levels.begin();
+		BBN_CHECK(prefix > 0);
+		BBN_CHECK(bbn_test::minimumSpacing(samples.begin(), samples.begin() + prefix) > radii[level]);
+	}
+	BBN_CHECK(levels.front() == 0 && levels.back() == 2);
+
+	// Saturated levels pass their attempts on.
+	dt.setMaximumConsecutiveFailures(200);
+	UniformSampler saturating(7);
+	samples.clear();
+	levels.clear();
+	BBN_CHECK(dt.resampleProgressive(saturating, radii, std::back_inserter(samples), std::back_inserter(levels)));
+	BBN_CHECK(saturating.count() <= nAttempts);
+	BBN_CHECK(std::count(levels.begin(), levels.end(), 2) > 0);
+}
+
+/* Class of a dart given by its feature. */
+struct FeatureClass {
+	int operator()(const PlaneTraits::Vector &v) const {
+		return v(2) < 0.1f ? 0 : (v(2) < 0.15f ? 1 : 2);
+	}
+};
+
+/* Every pair of multi-class samples is separated by the radius of their classes, including the radius of pairs
+   whose entries in the radius matrix differ. */
+void testMultiClass()
+{
+	typedef bbn::DartThrowing<PlaneTraits> DT;
+	DT dt = makeDartThrowing(0.03f, 4000);
+
+	std::vector<float> classRadii;
+	classRadii.push_back(0.04f);
+	classRadii.push_back(0.06f);
+	classRadii.push_back(0.08f);
+	DT::RadiusMatrix radii = dt.buildMultiClassRadii(classRadii);
+	BBN_CHECK(radii.isApprox(radii.transpose()));
+	BBN_CHECK(radii(0, 0) == 0.04f && radii(2, 2) == 0.08f);
+	BBN_CHECK(radii(0, 2) < 0.04f);
+	radii(1, 0) = 0.1f;
+
+	FeatureClass classOf;
+	UniformSampler sampler(8);
+	ArrayOfVector samples;
+	std::vector<int> classes;
+	BBN_CHECK(dt.resampleMultiClass(sampler, classOf, radii, std::back_inserter(samples), std::back_inserter(classes)));
+	BBN_CHECK(classes.size() == samples.size());
+
+	bool spaced = true;
+	int counts[3] = { 0, 0, 0 };
+	for (size_t i = 0; i < samples.size(); ++i) {
+		BBN_CHECK(classes[i] == classOf(samples[i]));
+		++counts[classes[i]];
+		for (size_t j = i + 1; j < samples.size(); ++j) {
+			const float r = std::max(radii(classes[i], classes[j]), radii(classes[j], classes[i]));
+			spaced &= (samples[i] - samples[j]).norm() > r;
+		}
+	}
+	BBN_CHECK(spaced);
+	BBN_CHECK(counts[0] > 0 && counts[1] > 0 && counts[2] > 0);
+}
+
+int main()
+{
+	testParallel();
+	testStopReasons();
+	testMaximal();
+	testResampleToCount();
+	testVariableRadius();
+	testBlocks();
+	testProgressive();
+	testMultiClass();
+
+	return bbn_test::report("dart_throwing");
+}
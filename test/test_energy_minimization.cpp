@@ -0,0 +1,314 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "test_util.h"
+#include <bbn/energy_minimization.h>
+#include <bbn/task_traits.h>
+
+typedef bbn::TaskTraits<float, 2, 1> PlaneTraits;
+typedef bbn::EnergyMinimization<PlaneTraits> EM;
+typedef std::vector<PlaneTraits::Vector, Eigen::aligned_allocator<PlaneTraits::Vector> > ArrayOfVector;
+
+const float sigma = 0.03f;
+
+/* Jittered grid of n x n samples in the unit square with a feature dimension. */
+ArrayOfVector jitteredGrid(int n, unsigned seed)
+{
+	bbn_test::Random rnd(seed);
+	ArrayOfVector samples;
+	for (int y = 0; y < n; ++y) {
+		for (int x = 0; x < n; ++x) {
+			PlaneTraits::Vector v;
+			v << (x + rnd()) / n, (y + rnd()) / n, rnd() * 0.01f;
+			samples.push_back(v);
+		}
+	}
+	return samples;
+}
+
+/* Keep samples within the unit square. */
+struct ClampToSquare {
+	void operator()(PlaneTraits::VectorLike v) const {
+		v(0) = std::min(std::max(v(0), 0.f), 1.f);
+		v(1) = std::min(std::max(v(1), 0.f), 1.f);
+	}
+};
+
+/* Minimizer with the kernel and step size used by the tests. */
+EM makeMinimizer()
+{
+	PlaneTraits traits;
+	PlaneTraits::Locator::Params params;
+	params.bucketResolution = 2.576f * sigma;
+	traits.setLocatorParams(params);
+
+	EM em;
+	em.setTaskTraits(traits);
+	em.setKernelSigma(sigma);
+	em.setMaximumSearchRadius(2.576f * sigma);
+	em.setStepSize(0.45f * sigma * sigma);
+	return em;
+}
+
+/* Run the minimizer on the given samples and return the refined samples. */
+ArrayOfVector minimize(EM &em, const ArrayOfVector &samples, size_t nIterations)
+{
+	ArrayOfVector refined;
+	BBN_CHECK(em.minimize(samples.begin(), samples.end(), std::back_inserter(refined), ClampToSquare(), nIterations));
+	BBN_CHECK(refined.size() == samples.size());
+	return refined;
+}
+
+/* Largest distance between corresponding samples. */
+float maximumDeviation(const ArrayOfVector &a, const ArrayOfVector &b)
+{
+	float d = 0;
+	for (size_t i = 0; i < a.size(); ++i) {
+		d = std::max(d, (a[i] - b[i]).norm());
+	}
+	return d;
+}
+
+/* Multi-threaded sweeps yield the same energies and positions as a single thread, whether samples are constrained
+   concurrently or on the calling thread. Minimization decreases the energy. */
+void testThreads()
+{
+	const ArrayOfVector samples = jitteredGrid(24, 1);
+
+	EM em = makeMinimizer();
+	const ArrayOfVector initial = minimize(em, samples, 1);
+	const float initialEnergy = em.getEnergy();
+
+	const ArrayOfVector single = minimize(em, samples, 8);
+	const float singleEnergy = em.getEnergy();
+	BBN_CHECK(em.getIterations() == 8);
+	BBN_CHECK(em.getStopReason() == EM::StopMaximumIterations);
+	BBN_CHECK(singleEnergy < initialEnergy);
+	BBN_CHECK(maximumDeviation(initial, single) > 0);
+
+	const int threads[] = { 3, 0 };
+	for (int t = 0; t < 2; ++t) {
+		em.setNumberOfThreads(threads[t]);
+		for (int threadSafe = 0; threadSafe < 2; ++threadSafe) {
+			em.setConstraintThreadSafe(threadSafe != 0);
+			const ArrayOfVector parallel = minimize(em, samples, 8);
+			BBN_CHECK(em.getEnergy() == singleEnergy);
+			BBN_CHECK(maximumDeviation(parallel, single) == 0);
+		}
+	}
+}
+
+/* Visiting each pair once yields the energies and positions of visiting pairs from both samples, independent
+   of the number of threads and of the input order, while evaluating little more than half the pairs. */
+void testSymmetricPairs()
+{
+	ArrayOfVector samples = jitteredGrid(40, 2);
+	bbn_test::Random rnd(2);
+	for (size_t i = samples.size() - 1; i > 0; --i) {
+		std::swap(samples[i], samples[static_cast<size_t>(rnd() * (i + 1))]);
+	}
+
+	EM em = makeMinimizer();
+	const ArrayOfVector perSample = minimize(em, samples, 6);
+	const float perSampleEnergy = em.getEnergy();
+	const size_t perSampleEvaluations = em.getKernelEvaluations();
+
+	em.setSymmetricPairs(true);
+	const ArrayOfVector pairs = minimize(em, samples, 6);
+	const float pairEnergy = em.getEnergy();
+	BBN_CHECK_CLOSE(pairEnergy, perSampleEnergy, 1e-5);
+	BBN_CHECK(maximumDeviation(pairs, perSample) < 1e-5f);
+	BBN_CHECK(em.getKernelEvaluations() > perSampleEvaluations / 2);
+	BBN_CHECK(em.getKernelEvaluations() < perSampleEvaluations * 6 / 10);
+
+	// Cached neighbor lists skip the same pairs.
+	em.setNeighborListSkin(0.5f * sigma);
+	minimize(em, samples, 6);
+	BBN_CHECK(em.getKernelEvaluations() < perSampleEvaluations * 6 / 10);
+	em.setNeighborListSkin(0);
+
+	const int threads[] = { 2, 5 };
+	for (int t = 0; t < 2; ++t) {
+		em.setNumberOfThreads(threads[t]);
+		const ArrayOfVector parallel = minimize(em, samples, 6);
+		BBN_CHECK(em.getEnergy() == pairEnergy);
+		BBN_CHECK(maximumDeviation(parallel, pairs) == 0);
+	}
+}
+
+/* Largest relative error of the exp approximation on [minArgument, 0]. */
+template<class Scalar>
+double maximumRelativeError(const bbn::detail::ExpApproximation<Scalar> &approx, Scalar minArgument)
+{
+	typedef Eigen::Array<Scalar, Eigen::Dynamic, 1> Array;
+	const int n = 4001;
+	Array x(n), y(n);
+	for (int i = 0; i < n; ++i) {
+		x(i) = minArgument * Scalar(i) / Scalar(n - 1);
+	}
+	approx.evaluate(x, y);
+
+	double e = 0;
+	for (int i = 0; i < n; ++i) {
+		const double ref = std::exp(static_cast<double>(x(i)));
+		e = std::max(e, std::abs(static_cast<double>(y(i)) - ref) / ref);
+	}
+	return e;
+}
+
+/* The approximated kernel stays within the requested relative error over the range of kernel arguments, zero
+   selects the exact exp. Requests below the rounding error of the evaluation are raised to a bound that still holds,
+   also when the polynomial degree is exhausted. Minimization with an approximated kernel stays close to the exact
+   kernel. */
+void testKernelApproximation()
+{
+	const float minArgument = -0.5f * 2.576f * 2.576f;
+	BBN_CHECK(bbn::detail::ExpApproximation<float>().exact());
+	BBN_CHECK(bbn::detail::ExpApproximation<float>(minArgument, 0).exact());
+	BBN_CHECK(maximumRelativeError(bbn::detail::ExpApproximation<float>(), minArgument) < 1e-6);
+
+	const float floatErrors[] = { 1e-2f, 1e-3f, 1e-4f };
+	for (int k = 0; k < 3; ++k) {
+		const bbn::detail::ExpApproximation<float> approx(minArgument, floatErrors[k]);
+		BBN_CHECK(!approx.exact());
+		BBN_CHECK(approx.maxRelativeError() == floatErrors[k]);
+		BBN_CHECK(maximumRelativeError(approx, minArgument) <= floatErrors[k]);
+	}
+
+	const double doubleErrors[] = { 1e-3, 1e-6, 1e-9 };
+	for (int k = 0; k < 3; ++k) {
+		const bbn::detail::ExpApproximation<double> approx(minArgument, doubleErrors[k]);
+		BBN_CHECK(approx.maxRelativeError() == doubleErrors[k]);
+		BBN_CHECK(maximumRelativeError(approx, double(minArgument)) <= doubleErrors[k]);
+	}
+
+	// Errors below the rounding error of float, and below the truncation error of the largest degree.
+	const bbn::detail::ExpApproximation<float> floatLimit(minArgument, 1e-7f);
+	BBN_CHECK(floatLimit.maxRelativeError() > 1e-7f && floatLimit.maxRelativeError() < 1e-5f);
+	BBN_CHECK(maximumRelativeError(floatLimit, minArgument) <= floatLimit.maxRelativeError());
+
+	const bbn::detail::ExpApproximation<double> doubleLimit(minArgument, 1e-19);
+	BBN_CHECK(doubleLimit.maxRelativeError() > 1e-19 && doubleLimit.maxRelativeError() < 1e-13);
+	BBN_CHECK(maximumRelativeError(doubleLimit, double(minArgument)) <= doubleLimit.maxRelativeError());
+
+	const ArrayOfVector samples = jitteredGrid(16, 3);
+	EM em = makeMinimizer();
+	const ArrayOfVector exact = minimize(em, samples, 4);
+	const float exactEnergy = em.getEnergy();
+
+	em.setKernelApproximation(1e-3f);
+	const ArrayOfVector approximated = minimize(em, samples, 4);
+	BBN_CHECK_CLOSE(em.getEnergy(), exactEnergy, 1e-3);
+	BBN_CHECK(maximumDeviation(approximated, exact) < 1e-3f * sigma);
+}
+
+/* Cached neighbor lists yield the energies and positions of querying the locator in every iteration, also when
+   lists are rebuilt frequently because of a small skin. */
+void testNeighborLists()
+{
+	const ArrayOfVector samples = jitteredGrid(20, 4);
+
+	for (int symmetric = 0; symmetric < 2; ++symmetric) {
+		EM em = makeMinimizer();
+		em.setSymmetricPairs(symmetric != 0);
+		const ArrayOfVector direct = minimize(em, samples, 10);
+		const float directEnergy = em.getEnergy();
+
+		const float skins[] = { 0.5f * sigma, 0.01f * sigma };
+		for (int k = 0; k < 2; ++k) {
+			em.setNeighborListSkin(skins[k]);
+			const ArrayOfVector cached = minimize(em, samples, 10);
+			BBN_CHECK_CLOSE(em.getEnergy(), directEnergy, 1e-5);
+			BBN_CHECK(maximumDeviation(cached, direct) < 1e-5f);
+		}
+	}
+}
+
+/* Adaptive step schedules reach at most the energy of the fixed step size within the same number of iterations.
+   Bold driver never accepts a step that increases the energy. */
+void testStepSchedules()
+{
+	const ArrayOfVector samples = jitteredGrid(20, 5);
+	const size_t nIterations = 12;
+
+	EM em = makeMinimizer();
+	em.setStepSize(0.1f * sigma * sigma);
+	minimize(em, samples, nIterations);
+	const float fixedEnergy = em.getEnergy();
+
+	em.setStepSchedule(EM::BoldDriverStep);
+	float prevEnergy = std::numeric_limits<float>::infinity();
+	bool decreasing = true;
+	for (size_t n = 1; n <= nIterations; ++n) {
+		minimize(em, samples, n);
+		decreasing &= em.getEnergy() <= prevEnergy;
+		prevEnergy = em.getEnergy();
+	}
+	BBN_CHECK(decreasing);
+	BBN_CHECK(prevEnergy < fixedEnergy);
+
+	em.setStepSchedule(EM::BarzilaiBorweinStep);
+	minimize(em, samples, nIterations);
+	BBN_CHECK(em.getEnergy() < fixedEnergy);
+
+	// Large initial steps are rejected until the energy decreases.
+	em.setStepSchedule(EM::BoldDriverStep);
+	em.setStepSize(20 * sigma * sigma);
+	minimize(em, samples, 1);
+	const float initialEnergy = em.getEnergy();
+	minimize(em, samples, nIterations);
+	BBN_CHECK(em.getEnergy() < initialEnergy);
+}
+
+/* Samples stay active while adapted steps shrink and the energy still decreases, ending close to the energy of
+   evaluating all samples. Samples settle once their displacement stays below the threshold. */
+void testActiveSet()
+{
+	const ArrayOfVector samples = jitteredGrid(20, 6);
+	const size_t nIterations = 20;
+
+	// Bold driver rejects the large initial steps, so that displacements are small before the step size settled.
+	EM em = makeMinimizer();
+	em.setStepSchedule(EM::BoldDriverStep);
+	em.setStepSize(20 * sigma * sigma);
+	minimize(em, samples, nIterations);
+	const float allEnergy = em.getEnergy();
+
+	em.setActiveSetThreshold(0.2f * sigma);
+	minimize(em, samples, nIterations);
+	BBN_CHECK(em.getStopReason() == EM::StopMaximumIterations);
+	BBN_CHECK(em.getIterations() == nIterations);
+	BBN_CHECK_CLOSE(em.getEnergy(), allEnergy, 1e-2);
+
+	// Large thresholds settle all samples.
+	em.setStepSchedule(EM::FixedStep);
+	em.setStepSize(0.45f * sigma * sigma);
+	em.setActiveSetThreshold(sigma);
+	minimize(em, samples, nIterations);
+	BBN_CHECK(em.getStopReason() == EM::StopNoActiveSamples);
+	BBN_CHECK(em.getIterations() < nIterations);
+}
+
+int main()
+{
+	testThreads();
+	testSymmetricPairs();
+	testKernelApproximation();
+	testNeighborLists();
+	testStepSchedules();
+	testActiveSet();
+
+	return bbn_test::report("energy_minimization");
+}
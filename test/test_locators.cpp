@@ -0,0 +1,470 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <Eigen/Dense>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include "test_util.h"
+
+#include <bbn/meta.h>
+#include <bbn/neighbor_lists.h>
+
+typedef Eigen::Matrix<float, 6, 1> Vector6;
+
+/* Random points in the unit cube scaled per dimension. */
+template<class VectorT>
+std::vector<VectorT, Eigen::aligned_allocator<VectorT> > randomPoints(bbn_test::Random &rnd, size_t n, const Eigen::VectorXf &scale)
+{
+	std::vector<VectorT, Eigen::aligned_allocator<VectorT> > points(n);
+	for (size_t i = 0; i < n; ++i) {
+		VectorT v(scale.rows());
+		for (Eigen::Index d = 0; d < scale.rows(); ++d) {
+			v(d) = rnd() * scale(d);
+		}
+		points[i] = v;
+	}
+	return points;
+}
+
+/* Compare all query types of the given locator against a bruteforce locator holding the same points. Queries are
+   drawn from the scaled unit cube moved by shift along the first dimension. */
+template<class Locator, class VectorT>
+void compareWithBruteforce(const Locator &loc, const bbn::BruteforceLocator<VectorT> &ref, bbn_test::Random &rnd, const Eigen::VectorXf &scale, float minRadius, float maxRadius, int nQueries, float shift = 0)
+{
+	std::vector<size_t> a, b;
+	std::vector<float> da, db;
+
+	for (int q = 0; q < nQueries; ++q) {
+		VectorT query(scale.rows());
+		for (Eigen::Index d = 0; d < scale.rows(); ++d) {
+			query(d) = rnd() * scale(d);
+		}
+		query(0) += shift;
+		const float radius = minRadius + rnd() * (maxRadius - minRadius);
+
+		loc.findAllWithinRadius(query, radius, a, da);
+		ref.findAllWithinRadius(query, radius, b, db);
+		std::sort(a.begin(), a.end());
+		std::sort(b.begin(), b.end());
+		BBN_CHECK(a == b);
+
+		size_t id;
+		float d2;
+		const bool any = loc.findAnyWithinRadius(query, radius, &id, &d2);
+		BBN_CHECK(any == !b.empty());
+		if (any) {
+			BBN_CHECK(std::binary_search(b.begin(), b.end(), id));
+		}
+
+		size_t closest;
+		float closestDist2;
+		const bool found = loc.findClosestWithinRadius(query, radius, closest, closestDist2);
+		if (!b.empty()) {
+			BBN_CHECK(found);
+			BBN_CHECK_CLOSE(closestDist2, *std::min_element(db.begin(), db.end()), 1e-5);
+		} else {
+			// BruteforceLocator slightly extends the radius of closest point queries.
+			BBN_CHECK(!found || closestDist2 > radius * radius);
+		}
+	}
+}
+
+/* Queries of bucket based locators agree with bruteforce search whether they are served by a prepared stencil, by
+   iterating the bucket range around the query or by visiting all buckets. Stencils of radii that are too large in
+   many dimensions are not computed. Prepared locators are queried concurrently with varying radii. */
+template<class Locator, class VectorT>
+void testStencilPaths(Locator &loc, const bbn::BruteforceLocator<VectorT> &ref, bbn_test::Random &rnd, const Eigen::VectorXf &scale)
+{
+	loc.prepare(0.1f);
+	loc.prepare(0.15f);
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.15f, 100);
+
+	// Exceeds the maximum stencil size at the test resolutions.
+	loc.prepare(1.5f);
+	compareWithBruteforce(loc, ref, rnd, scale, 0.5f, 1.5f, 20);
+
+	typename bbn::detail::Bucketing<VectorT>::Stencil stencil;
+	stencil.compute(6, 1.5f, typename bbn::detail::Bucketing<VectorT>::Resolution(0.1f));
+	BBN_CHECK(!stencil.bounded);
+	BBN_CHECK(stencil.size() == 0);
+
+	Eigen::MatrixXf queries(6, 200);
+	for (Eigen::Index i = 0; i < queries.cols(); ++i) {
+		queries.col(i) = loc.get(static_cast<size_t>(i));
+	}
+
+	const bbn::NeighborLists<float> small = bbn::findAllWithinRadiusBatch(loc, queries, 0.1f, 1);
+	const bbn::NeighborLists<float> large = bbn::findAllWithinRadiusBatch(loc, queries, 0.15f, 1);
+
+	bbn::NeighborLists<float> concurrentSmall, concurrentLarge;
+	std::thread t([&]() { concurrentSmall = bbn::findAllWithinRadiusBatch(loc, queries, 0.1f, 2); });
+	concurrentLarge = bbn::findAllWithinRadiusBatch(loc, queries, 0.15f, 2);
+	t.join();
+
+	BBN_CHECK(small.offsets == concurrentSmall.offsets && small.indices == concurrentSmall.indices);
+	BBN_CHECK(large.offsets == concurrentLarge.offsets && large.indices == concurrentLarge.indices);
+}
+
+/* GridLocator answers like bruteforce search, both for bulk built and incrementally added points. */
+template<class VectorT>
+void testGridLocator()
+{
+	bbn_test::Random rnd(1);
+	Eigen::VectorXf scale(6);
+	scale << 1, 1, 1, 0.2f, 0.2f, 0.2f;
+
+	typename bbn::GridLocator<VectorT>::Params p;
+	p.bucketResolution = 0.1f;
+
+	std::vector<VectorT, Eigen::aligned_allocator<VectorT> > points = randomPoints<VectorT>(rnd, 1000, scale);
+	Eigen::MatrixXf m(6, points.size());
+	for (size_t i = 0; i < points.size(); ++i) {
+		m.col(i) = points[i];
+	}
+
+	bbn::GridLocator<VectorT> bulk(p);
+	bbn::BruteforceLocator<VectorT> ref;
+	bulk.build(m);
+	ref.build(m);
+	compareWithBruteforce(bulk, ref, rnd, scale, 0.02f, 0.15f, 100);
+	testStencilPaths(bulk, ref, rnd, scale);
+
+	// Incremental insertion exercises both the pending list and the periodic rebuild.
+	bbn::GridLocator<VectorT> incremental(p);
+	for (size_t i = 0; i < points.size(); ++i) {
+		incremental.add(points[i]);
+		if (i == 100 || i == 500) {
+			bbn::BruteforceLocator<VectorT> partial;
+			partial.add(points.begin(), points.begin() + i + 1);
+			compareWithBruteforce(incremental, partial, rnd, scale, 0.02f, 0.15f, 50);
+		}
+	}
+	compareWithBruteforce(incremental, ref, rnd, scale, 0.02f, 0.15f, 100);
+}
+
+/* Moving points in place through update() yields the same answers as a locator filled with the final positions. */
+template<class Locator, class VectorT>
+void testUpdate(const typename Locator::Params &p)
+{
+	bbn_test::Random rnd(2);
+	Eigen::VectorXf scale(6);
+	scale << 1, 1, 1, 0.2f, 0.2f, 0.2f;
+
+	std::vector<VectorT, Eigen::aligned_allocator<VectorT> > points = randomPoints<VectorT>(rnd, 1000, scale);
+
+	Locator loc(p);
+	bbn::BruteforceLocator<VectorT> moved;
+	loc.add(points.begin(), points.end());
+	moved.add(points.begin(), points.end());
+
+	// Small steps mostly stay within their bucket, large ones relocate the point.
+	for (int iter = 0; iter < 3; ++iter) {
+		const float step = iter == 1 ? 0.3f : 0.02f;
+		for (size_t i = 0; i < points.size(); ++i) {
+			for (Eigen::Index d = 0; d < scale.rows(); ++d) {
+				points[i](d) += (rnd() - 0.5f) * step * scale(d);
+			}
+			loc.update(i, points[i]);
+			moved.update(i, points[i]);
+		}
+	}
+
+	bbn::BruteforceLocator<VectorT> ref;
+	ref.add(points.begin(), points.end());
+
+	for (size_t i = 0; i < points.size(); ++i) {
+		BBN_CHECK(loc.get(i) == points[i]);
+	}
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.15f, 100);
+	compareWithBruteforce(moved, ref, rnd, scale, 0.02f, 0.15f, 100);
+}
+
+/* KdTreeLocator answers like bruteforce search for bulk built, incrementally added and duplicated points. */
+template<class VectorT>
+void testKdTreeLocator()
+{
+	bbn_test::Random rnd(3);
+	Eigen::VectorXf scale(6);
+	scale << 1, 1, 1, 0.2f, 0.2f, 0.2f;
+
+	std::vector<VectorT, Eigen::aligned_allocator<VectorT> > points = randomPoints<VectorT>(rnd, 1000, scale);
+
+	// Clusters of duplicates form leaves that cannot be split.
+	for (size_t i = 0; i < 500; ++i) {
+		points.push_back(points[i % 5]);
+	}
+
+	Eigen::MatrixXf m(6, points.size());
+	for (size_t i = 0; i < points.size(); ++i) {
+		m.col(i) = points[i];
+	}
+
+	bbn::BruteforceLocator<VectorT> ref;
+	ref.build(m);
+
+	bbn::KdTreeLocator<VectorT> bulk;
+	bulk.build(m);
+	compareWithBruteforce(bulk, ref, rnd, scale, 0.02f, 0.3f, 100);
+
+	bbn::KdTreeLocator<VectorT> incremental;
+	incremental.add(points.begin(), points.end());
+	compareWithBruteforce(incremental, ref, rnd, scale, 0.02f, 0.3f, 100);
+
+	std::vector<size_t> ids;
+	std::vector<float> dists2;
+	incremental.findAllWithinRadius(points[0], 1e-6f, ids, dists2);
+	BBN_CHECK(ids.size() == 101);
+}
+
+/* HashtableLocator answers like bruteforce search. Coarse buckets span several point blocks per bucket. */
+template<class VectorT>
+void testHashtableLocator(float resolution)
+{
+	bbn_test::Random rnd(4);
+	Eigen::VectorXf scale(6);
+	scale << 1, 1, 1, 0.2f, 0.2f, 0.2f;
+
+	typename bbn::HashtableLocator<VectorT>::Params p;
+	p.bucketResolution = resolution;
+
+	std::vector<VectorT, Eigen::aligned_allocator<VectorT> > points = randomPoints<VectorT>(rnd, 1000, scale);
+
+	bbn::HashtableLocator<VectorT> loc(p);
+	bbn::BruteforceLocator<VectorT> ref;
+	loc.add(points.begin(), points.end());
+	ref.add(points.begin(), points.end());
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.15f, 100);
+
+	testStencilPaths(loc, ref, rnd, scale);
+}
+
+/* HashtableLocator switches to hashed bucket codes once bucket coordinates exceed the bits of packed codes. */
+void testHashedCodes()
+{
+	bbn_test::Random rnd(6);
+	Eigen::VectorXf scale(6);
+	scale << 1, 1, 1, 0.2f, 0.2f, 0.2f;
+
+	bbn::HashtableLocator<Vector6>::Params p;
+	p.bucketResolution = 0.1f;
+
+	std::vector<Vector6, Eigen::aligned_allocator<Vector6> > points = randomPoints<Vector6>(rnd, 500, scale);
+	for (size_t i = 0; i < 500; ++i) {
+		points.push_back(points[i] + Vector6::UnitX() * 102.4f);
+	}
+
+	bbn::HashtableLocator<Vector6> loc(p);
+	bbn::BruteforceLocator<Vector6> ref;
+	loc.prepare(0.15f);
+
+	loc.add(points.begin(), points.begin() + 500);
+	ref.add(points.begin(), points.begin() + 500);
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.15f, 50);
+
+	// Far points alias with the near ones in packed codes of six dimensions.
+	loc.add(points.begin() + 500, points.end());
+	ref.add(points.begin() + 500, points.end());
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.15f, 50);
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.15f, 50, 102.4f);
+	compareWithBruteforce(loc, ref, rnd, scale, 0.3f, 0.5f, 20, 102.4f);
+
+	for (size_t i = 0; i < 100; ++i) {
+		std::swap(points[i], points[500 + i]);
+		loc.update(i, points[i]);
+		ref.update(i, points[i]);
+		loc.update(500 + i, points[500 + i]);
+		ref.update(500 + i, points[500 + i]);
+	}
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.15f, 50);
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.15f, 50, 102.4f);
+}
+
+/* Batched radius queries return the neighborhoods of individual queries regardless of the number of threads. */
+template<class Locator>
+void testBatchQueries()
+{
+	bbn_test::Random rnd(7);
+	Eigen::VectorXf scale(6);
+	scale << 1, 1, 1, 0.2f, 0.2f, 0.2f;
+
+	std::vector<Vector6, Eigen::aligned_allocator<Vector6> > points = randomPoints<Vector6>(rnd, 800, scale);
+	Eigen::MatrixXf m(6, points.size());
+	for (size_t i = 0; i < points.size(); ++i) {
+		m.col(i) = points[i];
+	}
+
+	Locator loc;
+	loc.prepare(0.15f);
+	loc.build(m);
+
+	std::vector<size_t> ids;
+	std::vector<float> dists2;
+	for (int nThreads = 1; nThreads <= 2; ++nThreads) {
+		const bbn::NeighborLists<float> lists = bbn::findAllWithinRadiusBatch(loc, m, 0.15f, nThreads);
+		BBN_CHECK(lists.size() == points.size());
+
+		bool equal = true;
+		for (size_t i = 0; i < points.size() && equal; ++i) {
+			loc.findAllWithinRadius(points[i], 0.15f, ids, dists2);
+			equal = lists.count(i) == ids.size() &&
+				std::equal(ids.begin(), ids.end(), lists.indices.begin() + lists.offsets[i]) &&
+				std::equal(dists2.begin(), dists2.end(), lists.dists2.begin() + lists.offsets[i]);
+		}
+		BBN_CHECK(equal);
+	}
+}
+
+/* forEachWithinRadius visits the same neighbors as findAllWithinRadius, only those accepted by a filter when given,
+   and stops as soon as the visitor asks to. */
+template<class Locator>
+void testForEachWithinRadius()
+{
+	bbn_test::Random rnd(8);
+	Eigen::VectorXf scale(6);
+	scale << 1, 1, 1, 0.2f, 0.2f, 0.2f;
+
+	std::vector<Eigen::VectorXf, Eigen::aligned_allocator<Eigen::VectorXf> > points = randomPoints<Eigen::VectorXf>(rnd, 1000, scale);
+
+	Locator loc;
+	loc.prepare(0.1f);
+	loc.add(points.begin(), points.end());
+
+	std::vector<size_t> ids, visited;
+	std::vector<float> dists2;
+	for (size_t q = 0; q < 100; ++q) {
+		loc.findAllWithinRadius(points[q], 0.1f, ids, dists2);
+
+		visited.clear();
+		BBN_CHECK(loc.forEachWithinRadius(points[q], 0.1f, [&](size_t id, float d2) {
+			visited.push_back(id);
+			return d2 <= 0.01f;
+		}));
+		BBN_CHECK(visited == ids);
+
+		// Filters rejecting scattered indices and whole ranges of indices.
+		for (int f = 0; f < 2; ++f) {
+			auto accept = [&](size_t id) {
+				return f == 0 ? id % 3 != 0 : id >= 500;
+			};
+
+			std::vector<size_t> expected;
+			std::copy_if(ids.begin(), ids.end(), std::back_inserter(expected), accept);
+
+			visited.clear();
+			BBN_CHECK(loc.forEachWithinRadius(points[q], 0.1f, [&](size_t id, float) {
+				visited.push_back(id);
+				return true;
+			}, accept));
+			BBN_CHECK(visited == expected);
+		}
+
+		const size_t stopAfter = ids.size() / 2 + 1;
+		size_t count = 0;
+		const bool completed = loc.forEachWithinRadius(points[q], 0.1f, [&](size_t, float) {
+			return ++count < stopAfter;
+		});
+		BBN_CHECK(!completed);
+		BBN_CHECK(count == stopAfter);
+	}
+}
+
+/* Bucket based locators with separate resolutions for the position and feature block answer like bruteforce search. */
+template<class Locator>
+void testBlockResolutions()
+{
+	bbn_test::Random rnd(9);
+	Eigen::VectorXf scale(6);
+	scale << 1, 1, 1, 0.2f, 0.2f, 0.2f;
+
+	std::vector<Vector6, Eigen::aligned_allocator<Vector6> > points = randomPoints<Vector6>(rnd, 1000, scale);
+
+	typename Locator::Params p;
+	p.setBlockResolutions(3, 0.1f, 3, 0.03f);
+
+	Locator loc(p);
+	bbn::BruteforceLocator<Vector6> ref;
+	loc.add(points.begin(), points.end());
+	ref.add(points.begin(), points.end());
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.1f, 100);
+
+	loc.prepare(0.1f);
+	compareWithBruteforce(loc, ref, rnd, scale, 0.02f, 0.1f, 100);
+}
+
+/* Stencil offsets are ordered nearest first starting with the home bucket, so that closest point queries can stop
+   early. Closest points found with a large prepared stencil match bruteforce search. */
+void testStencilOrder()
+{
+	typedef bbn::detail::Bucketing<Eigen::Vector3f> Bucketing;
+
+	Bucketing::Stencil stencil;
+	stencil.compute(3, 0.25f, Bucketing::Resolution(0.1f));
+	BBN_CHECK(stencil.bounded);
+	BBN_CHECK(stencil.size() > 1);
+	BBN_CHECK(stencil.offsets[0] == 0 && stencil.offsets[1] == 0 && stencil.offsets[2] == 0);
+	BBN_CHECK(std::is_sorted(stencil.minDist2.begin(), stencil.minDist2.end()));
+	BBN_CHECK(std::is_sorted(stencil.codeMinDist2.begin(), stencil.codeMinDist2.end()));
+	BBN_CHECK(stencil.minDist2.back() <= 0.25f * 0.25f);
+
+	bbn_test::Random rnd(10);
+	Eigen::VectorXf scale = Eigen::VectorXf::Ones(3);
+	std::vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f> > points = randomPoints<Eigen::Vector3f>(rnd, 2000, scale);
+
+	bbn::HashtableLocator<Eigen::Vector3f> loc;
+	bbn::BruteforceLocator<Eigen::Vector3f> ref;
+	loc.prepare(0.5f);
+	loc.add(points.begin(), points.end());
+	ref.add(points.begin(), points.end());
+	compareWithBruteforce(loc, ref, rnd, scale, 0.01f, 0.5f, 200);
+}
+
+int main()
+{
+	testGridLocator<Vector6>();
+	testGridLocator<Eigen::VectorXf>();
+
+	bbn::HashtableLocator<Vector6>::Params hp;
+	hp.bucketResolution = 0.1f;
+	testUpdate<bbn::HashtableLocator<Vector6>, Vector6>(hp);
+	testUpdate<bbn::BruteforceLocator<Vector6>, Vector6>(bbn::BruteforceLocator<Vector6>::Params());
+
+	testHashtableLocator<Vector6>(0.1f);
+	testHashtableLocator<Vector6>(0.5f);
+	testHashtableLocator<Eigen::VectorXf>(0.1f);
+	testHashedCodes();
+
+	testKdTreeLocator<Vector6>();
+	testKdTreeLocator<Eigen::VectorXf>();
+	testUpdate<bbn::KdTreeLocator<Vector6>, Vector6>(bbn::KdTreeLocator<Vector6>::Params());
+
+	testStencilOrder();
+
+	testBlockResolutions< bbn::HashtableLocator<Vector6> >();
+	testBlockResolutions< bbn::GridLocator<Vector6> >();
+
+	testForEachWithinRadius< bbn::BruteforceLocator<Eigen::VectorXf> >();
+	testForEachWithinRadius< bbn::HashtableLocator<Eigen::VectorXf> >();
+	testForEachWithinRadius< bbn::GridLocator<Eigen::VectorXf> >();
+	testForEachWithinRadius< bbn::KdTreeLocator<Eigen::VectorXf> >();
+
+	testBatchQueries< bbn::BruteforceLocator<Vector6> >();
+	testBatchQueries< bbn::HashtableLocator<Vector6> >();
+	testBatchQueries< bbn::GridLocator<Vector6> >();
+	testBatchQueries< bbn::KdTreeLocator<Vector6> >();
+
+	return bbn_test::report("test_locators");
+}
@@ -0,0 +1,74 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "test_util.h"
+#include <bbn/sample_elimination.h>
+#include <bbn/task_traits.h>
+
+typedef bbn::TaskTraits<float, 3, 0> SpaceTraits;
+typedef std::vector<SpaceTraits::Vector, Eigen::aligned_allocator<SpaceTraits::Vector> > ArrayOfVector;
+
+/* Random points in the unit cube, flattened onto the plane z = 0 for two dimensional domains. */
+ArrayOfVector randomPoints(bbn_test::Random &rnd, size_t n, int dims)
+{
+	ArrayOfVector points(n);
+	for (size_t i = 0; i < n; ++i) {
+		points[i] << rnd(), rnd(), (dims == 3) ? rnd() : 0.f;
+	}
+	return points;
+}
+
+/* The requested number of samples remains and the samples are spread at a large fraction of the spacing of the
+   densest packing in the domain, whether it is a plane or a volume. */
+void testElimination(int dims, size_t nInput, size_t nOutput, float packingSpacing)
+{
+	bbn_test::Random rnd(dims);
+	const ArrayOfVector points = randomPoints(rnd, nInput, dims);
+
+	SpaceTraits traits;
+	SpaceTraits::Locator::Params params;
+	params.bucketResolution = packingSpacing;
+	traits.setLocatorParams(params);
+
+	bbn::SampleElimination<SpaceTraits> se;
+	se.setTaskTraits(traits);
+	se.setNumberOfThreads(1);
+
+	ArrayOfVector samples;
+	BBN_CHECK(se.resample(points.begin(), points.end(), nOutput, std::back_inserter(samples)));
+	BBN_CHECK(samples.size() == nOutput);
+
+	const float spacing = bbn_test::minimumSpacing(samples.begin(), samples.end());
+	const float randomSpacing = bbn_test::minimumSpacing(points.begin(), points.begin() + nOutput);
+	BBN_CHECK(spacing > 0.5f * packingSpacing);
+	BBN_CHECK(spacing > 2 * randomSpacing);
+
+	// An explicit radius yields the same number of samples.
+	se.setMaximumRadius(0.5f * packingSpacing);
+	samples.clear();
+	BBN_CHECK(se.resample(points.begin(), points.end(), nOutput, std::back_inserter(samples)));
+	BBN_CHECK(samples.size() == nOutput);
+	BBN_CHECK(bbn_test::minimumSpacing(samples.begin(), samples.end()) > 0.5f * packingSpacing);
+}
+
+int main()
+{
+	// Hexagonal packing covers an area of 2 * sqrt(3) * (s / 2)^2 per sample of spacing s.
+	testElimination(2, 3000, 200, std::sqrt(4.f / (200 * 2 * std::sqrt(3.f))));
+	// Face centered cubic packing covers a volume of 4 * sqrt(2) * (s / 2)^3 per sample.
+	testElimination(3, 3000, 200, std::pow(8.f / (200 * 4 * std::sqrt(2.f)), 1.f / 3));
+
+	return bbn_test::report("sample_elimination");
+}
@@ -0,0 +1,99 @@
+// This file is part of BilateralBlueNoisePointcloudSampling (BBNPS).
+//
+// Copyright (C) 2014 Christoph Heindl <christoph.heindl@gmail.com>
+//
+// BBNPS is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or any later version.
+//
+// BBNPS is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BBN_TEST_UTIL_H
+#define BBN_TEST_UTIL_H
+
+#include <Eigen/Dense>
+#include <iostream>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+/* Minimal checking facilities shared by the regression tests. A failing check is reported and counted,
+   the test executable returns non-zero if any check failed. */
+
+#define BBN_CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			++bbn_test::failures(); \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+		} \
+	} while (0)
+
+#define BBN_CHECK_CLOSE(a, b, tol) \
+	do { \
+		const double bbnA = static_cast<double>(a), bbnB = static_cast<double>(b); \
+		if (!(std::abs(bbnA - bbnB) <= (tol) * std::max(1.0, std::max(std::abs(bbnA), std::abs(bbnB))))) { \
+			++bbn_test::failures(); \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #a " (" << bbnA << ") ~ " #b " (" << bbnB << ")" << std::endl; \
+		} \
+	} while (0)
+
+namespace bbn_test {
+
+	/** Number of failed checks. */
+	inline int &failures()
+	{
+		static int n = 0;
+		return n;
+	}
+
+	/** Print summary and return the process exit code. */
+	inline int report(const char *name)
+	{
+		if (failures() == 0) {
+			std::cout << name << ": all checks passed" << std::endl;
+			return 0;
+		}
+		std::cout << name << ": " << failures() << " check(s) failed" << std::endl;
+		return 1;
+	}
+
+	/** Deterministic uniform random number generator in [0, 1). */
+	class Random {
+	public:
+		explicit Random(unsigned seed = 42)
+			:_state(seed * 2654435761u + 1)
+		{}
+
+		float operator()()
+		{
+			_state = _state * 1664525u + 1013904223u;
+			return static_cast<float>(_state >> 8) / static_cast<float>(1u << 24);
+		}
+
+	private:
+		unsigned _state;
+	};
+
+	/** Smallest pairwise distance of the given range of vectors. Infinity for less than two vectors. */
+	template<class Iter>
+	float minimumSpacing(Iter begin, Iter end)
+	{
+		float best2 = std::numeric_limits<float>::infinity();
+		for (Iter i = begin; i != end; ++i) {
+			Iter j = i;
+			for (++j; j != end; ++j) {
+				best2 = std::min(best2, static_cast<float>((*i - *j).squaredNorm()));
+			}
+		}
+		return std::sqrt(best2);
+	}
+
+}
+
+#endif